@@ -0,0 +1,307 @@
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "simulation/System.h"
+#include "simulation/ColorMatrix.h"
+#include "simulation/ColorForce.h"
+#include "simulation/FrictionForce.h"
+#include "simulation/Observables.h"
+#include "simulation/SpatialQuery.h"
+#include "debug/AllocationCounter.h"
+
+using namespace Speck;
+
+struct BenchmarkConfig
+{
+  std::size_t NumParticles = 20000;
+  std::size_t NumSteps = 200;
+  std::size_t NumWarmup = 20;
+  std::size_t NumColors = 5;
+  float Size = 400.0f;
+  float Timestep = 1.0f / 60.0f;
+  unsigned int Seed = 1234;
+
+  // Spatial queries
+  std::size_t NumQueryParticles = 1000000;
+  std::size_t NumQueries = 100;
+  float QuerySize = 2000.0f;
+  float QueryRadius = 40.0f;  // also the half width of the rects
+  std::size_t QueryNeighbors = 16;
+};
+
+// What differs between the benchmark runs
+struct RunOptions
+{
+  bool Tabulated = false;
+  std::size_t SampleInterval = 0; // observables are only measured with an interval
+  BoundaryMode Boundary = BoundaryMode::Periodic;
+  bool Sleeping = false;
+  bool Generic = false; // the kernel that checks every setting per pair
+};
+
+// Mirrors the simulation step in Specks::OnUpdate
+static void Step(System& system, ColorForce& colorForce, FrictionForce& frictionForce, const ColorMatrix& matrix, float timestep)
+{
+  system.ZeroForces();
+  colorForce.ApplyForces(&system, matrix, timestep);
+  frictionForce.ApplyForces(&system, timestep);
+
+  system.UpdatePositions(timestep);
+  system.ApplyBoundary();
+  system.PartitionsParticles();
+}
+
+// Runs the simulation from the same starting point for each configuration. Returns false if the steady state allocated.
+static bool RunBenchmark(const char* label, const BenchmarkConfig& config, const RunOptions& options, double& msPerStep)
+{
+  ColorMatrix matrix(config.NumColors);
+  std::srand(config.Seed); // after the matrix, which seeds with the time
+  System system(config.NumParticles, config.NumColors, config.Size);
+  system.SetBoundaryMode(options.Boundary);
+  system.SetSleeping(options.Sleeping);
+
+  ColorForce colorForce;
+  colorForce.SetTabulated(options.Tabulated);
+  colorForce.SetGenericKernel(options.Generic);
+  FrictionForce frictionForce;
+
+  // Observables are only measured with a sample interval
+  Observables observables;
+  observables.SetEnabled(options.SampleInterval > 0);
+  observables.SetSampleInterval(options.SampleInterval);
+  colorForce.SetObservables(&observables);
+
+  // Let the buffers grow to their working size
+  for (std::size_t i = 0; i < config.NumWarmup; i++)
+    Step(system, colorForce, frictionForce, matrix, config.Timestep);
+
+  std::size_t allocations = Debug::GetAllocationCount();
+  auto start = std::chrono::high_resolution_clock::now();
+
+  for (std::size_t i = 0; i < config.NumSteps; i++)
+    Step(system, colorForce, frictionForce, matrix, config.Timestep);
+
+  auto end = std::chrono::high_resolution_clock::now();
+  allocations = Debug::GetAllocationCount() - allocations;
+
+  msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / static_cast<double>(config.NumSteps);
+  std::printf("%-14s %zu particles, %zu steps: %.3fms per step\n", label, config.NumParticles, config.NumSteps, msPerStep);
+  if (options.Sleeping) std::printf("%-14s %zu of %zu cells asleep\n", label, system.GetNumSleepingCells(), system.GetCells().size());
+
+  // The steady state must never touch the heap
+  if (Debug::IsCountingAllocations())
+  {
+    std::printf("%-14s steady state allocations: %zu\n", label, allocations);
+    if (allocations != 0)
+    {
+      std::printf("FAILED: the simulation step allocated after warming up\n");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Times one query, adding to the total
+template <typename Func>
+static void TimeQuery(double& totalMs, Func func)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  func();
+  auto end = std::chrono::high_resolution_clock::now();
+  totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Distances of the given particles from a point, in order, so k nearest results can be compared even with ties
+static void GetDistancesSq(const std::vector<Particle>& particles, const std::vector<ParticleIndex>& indices, const glm::vec2& center, std::vector<float>& distancesSq)
+{
+  distancesSq.clear();
+  for (ParticleIndex index : indices)
+  {
+    glm::vec2 delta = particles[index].Position - center;
+    distancesSq.push_back(glm::dot(delta, delta));
+  }
+}
+
+// Checks each kind of spatial query against a linear scan over every particle, and times both.
+// Returns false if any query disagrees with the scan.
+static bool RunQueryBenchmark(const BenchmarkConfig& config)
+{
+  std::srand(config.Seed);
+  System system(config.NumQueryParticles, config.NumColors, config.QuerySize);
+  SpatialQuery query(&system);
+  const std::vector<Particle>& particles = system.GetParticles();
+
+  // Centers come from their own generator, so they don't depend on how the particles were made
+  std::mt19937 generator(config.Seed);
+  std::uniform_real_distribution<float> coordinate(-config.QuerySize, config.QuerySize);
+  std::uniform_int_distribution<int> colors(0, static_cast<int>(config.NumColors) - 1);
+
+  const float radiusSq = config.QueryRadius * config.QueryRadius;
+  const glm::vec2 halfExtent = glm::vec2(config.QueryRadius);
+  const std::size_t k = config.QueryNeighbors;
+
+  enum { RadiusQuery, RectQuery, NearestQuery, NumQueryKinds };
+  const char* names[NumQueryKinds] = { "Radius", "Rect", "Nearest" };
+  double gridMs[NumQueryKinds] = {}, scanMs[NumQueryKinds] = {};
+  std::size_t mismatches[NumQueryKinds] = {};
+
+  std::vector<ParticleIndex> results, expected;
+  std::vector<float> resultDistances, expectedDistances;
+  for (std::size_t i = 0; i < config.NumQueries; i++)
+  {
+    glm::vec2 center = { coordinate(generator), coordinate(generator) };
+    int color = colors(generator);
+
+    // Radius, order isn't part of the result
+    results.clear();
+    expected.clear();
+    TimeQuery(gridMs[RadiusQuery], [&]() { query.Radius(center, config.QueryRadius, results); });
+    TimeQuery(scanMs[RadiusQuery], [&]()
+    {
+      for (std::size_t j = 0; j < particles.size(); j++)
+      {
+        glm::vec2 delta = particles[j].Position - center;
+        if (glm::dot(delta, delta) <= radiusSq) expected.push_back(static_cast<ParticleIndex>(j));
+      }
+    });
+    std::sort(results.begin(), results.end());
+    if (results != expected) mismatches[RadiusQuery]++;
+
+    // Rect, filtered to one color
+    glm::vec2 min = center - halfExtent, max = center + halfExtent;
+    results.clear();
+    expected.clear();
+    TimeQuery(gridMs[RectQuery], [&]() { query.Rect(min, max, results, color); });
+    TimeQuery(scanMs[RectQuery], [&]()
+    {
+      for (std::size_t j = 0; j < particles.size(); j++)
+      {
+        const Particle& particle = particles[j];
+        const glm::vec2& position = particle.Position;
+        if (static_cast<int>(particle.Color) == color && position.x >= min.x && position.x <= max.x && position.y >= min.y && position.y <= max.y)
+          expected.push_back(static_cast<ParticleIndex>(j));
+      }
+    });
+    std::sort(results.begin(), results.end());
+    if (results != expected) mismatches[RectQuery]++;
+
+    // Nearest, compared by distance since equally distant particles can come back in either order
+    TimeQuery(gridMs[NearestQuery], [&]() { query.Nearest(center, k, results); });
+    TimeQuery(scanMs[NearestQuery], [&]()
+    {
+      expected.resize(particles.size());
+      for (std::size_t j = 0; j < particles.size(); j++)
+        expected[j] = static_cast<ParticleIndex>(j);
+      GetDistancesSq(particles, expected, center, expectedDistances);
+      std::size_t count = std::min(k, expectedDistances.size());
+      std::partial_sort(expectedDistances.begin(), expectedDistances.begin() + count, expectedDistances.end());
+      expectedDistances.resize(count);
+    });
+    GetDistancesSq(particles, results, center, resultDistances);
+    if (resultDistances != expectedDistances) mismatches[NearestQuery]++;
+  }
+
+  bool passed = true;
+  std::printf("Queries      %zu particles, %zu queries, radius %.1f, %zu nearest:\n", particles.size(), config.NumQueries, config.QueryRadius, k);
+  for (int kind = 0; kind < NumQueryKinds; kind++)
+  {
+    double grid = gridMs[kind] / static_cast<double>(config.NumQueries);
+    double scan = scanMs[kind] / static_cast<double>(config.NumQueries);
+    std::printf("  %-10s %.4fms per query, linear scan %.3fms (%.0fx)\n", names[kind], grid, scan, grid > 0.0 ? scan / grid : 0.0);
+    if (mismatches[kind] != 0)
+    {
+      std::printf("FAILED: %zu %s queries disagree with the linear scan\n", mismatches[kind], names[kind]);
+      passed = false;
+    }
+  }
+
+  return passed;
+}
+
+// Compares the tabulated force against the exact one at evenly spaced distances, relative to the strongest
+// force. Very short range is covered by the profile's core samples, so the error past that is reported separately.
+static void ReportAccuracy(float interactionRadius, float repulsionRadius)
+{
+  ForceProfile profile;
+  profile.Update(interactionRadius, repulsionRadius);
+  ForceTable table = profile.GetTable();
+
+  constexpr std::size_t numSamples = 100000;
+  const float shortRange = 0.05f * interactionRadius;
+  double maxError = 0.0, maxErrorPastShortRange = 0.0, sumSqError = 0.0;
+  float maxErrorDistance = 0.0f;
+  for (std::size_t i = 1; i <= numSamples; i++)
+  {
+    float distance = interactionRadius * static_cast<float>(i) / static_cast<float>(numSamples + 1);
+    glm::vec2 delta = glm::vec2(distance, 0.0f);
+
+    // Full attraction, so both parts of the curve are covered
+    glm::vec2 exact = PairForce<false>(delta, 0.0f, interactionRadius, repulsionRadius, 1.0f);
+    glm::vec2 tabulated = TabulatedPairForce<false>(delta, 0.0f, interactionRadius, table, 1.0f);
+
+    double error = glm::length(exact - tabulated);
+    sumSqError += error * error;
+    if (distance > shortRange && error > maxErrorPastShortRange) maxErrorPastShortRange = error;
+    if (error > maxError)
+    {
+      maxError = error;
+      maxErrorDistance = distance;
+    }
+  }
+
+  // Both parts of the default curve peak at the interaction radius
+  double peak = interactionRadius;
+  std::printf("Tabulated accuracy (%zu samples), as a percentage of the peak force:\n", profile.GetNumSamples());
+  std::printf("  max error %.4f%% (at distance %.2f), rms error %.4f%%\n", 100.0 * maxError / peak, maxErrorDistance, 100.0 * std::sqrt(sumSqError / numSamples) / peak);
+  std::printf("  max error past %.2f: %.4f%%\n", shortRange, 100.0 * maxErrorPastShortRange / peak);
+}
+
+// Usage: SpecksBenchmark [particles] [steps] [warmup steps] [colors] [query particles]
+int main(int argc, char** argv)
+{
+  BenchmarkConfig config;
+  if (argc > 1) config.NumParticles = std::strtoul(argv[1], nullptr, 10);
+  if (argc > 2) config.NumSteps = std::strtoul(argv[2], nullptr, 10);
+  if (argc > 3) config.NumWarmup = std::strtoul(argv[3], nullptr, 10);
+  if (argc > 4) config.NumColors = std::strtoul(argv[4], nullptr, 10);
+  if (argc > 5) config.NumQueryParticles = std::strtoul(argv[5], nullptr, 10);
+
+  // Compare the generic kernel against the one compiled for the configuration, and the exact force against the
+  // tabulated one. The cost of the observables is measured at their default interval, and on every step.
+  double genericMs = 0.0, exactMs = 0.0, tabulatedMs = 0.0, observedMs = 0.0, observedEveryStepMs = 0.0, observedOpenMs = 0.0;
+  bool passed = RunBenchmark("Generic", config, { .Generic = true }, genericMs);
+  passed &= RunBenchmark("Exact", config, {}, exactMs);
+  passed &= RunBenchmark("Tabulated", config, { .Tabulated = true }, tabulatedMs);
+  passed &= RunBenchmark("Observed", config, { .SampleInterval = Observables::s_DefaultSampleInterval }, observedMs);
+  passed &= RunBenchmark("Observed/1", config, { .SampleInterval = 1 }, observedEveryStepMs);
+
+  // Open boundaries remove particles nearly every step, which must not make the observables reallocate
+  passed &= RunBenchmark("Observed/Open", config, { .SampleInterval = 1, .Boundary = BoundaryMode::Open }, observedOpenMs);
+
+  // The other paths the steady state has to stay allocation free on
+  double sleepingMs = 0.0, openMs = 0.0;
+  passed &= RunBenchmark("Sleeping", config, { .Sleeping = true }, sleepingMs);
+  passed &= RunBenchmark("Open", config, { .Boundary = BoundaryMode::Open }, openMs);
+
+  if (exactMs > 0.0)
+    std::printf("Compiled kernel speedup: %.2fx\n", genericMs / exactMs);
+  if (tabulatedMs > 0.0)
+    std::printf("Tabulated kernel speedup: %.2fx\n", exactMs / tabulatedMs);
+  if (exactMs > 0.0)
+  {
+    std::printf("Observables overhead: %.1f%% (every %zu steps), %.1f%% (every step)\n", 100.0 * (observedMs - exactMs) / exactMs,
+                Observables::s_DefaultSampleInterval, 100.0 * (observedEveryStepMs - exactMs) / exactMs);
+  }
+
+  ReportAccuracy(System::s_DefaultInteractionRadius, ColorForce::s_DefaultRepulsionRadius);
+
+  passed &= RunQueryBenchmark(config);
+
+  return passed ? 0 : 1;
+}
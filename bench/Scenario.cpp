@@ -0,0 +1,480 @@
+#include "Scenario.h"
+
+#include <cmath>
+#include <random>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+
+namespace Speck
+{
+
+// The parts of TOML that scenarios use: tables, comments, and keys holding strings,
+// numbers, booleans or (nested) arrays, which may span several lines.
+enum class ValueType { String, Number, Boolean, Array };
+
+struct ScenarioValue
+{
+  ValueType Type = ValueType::Number;
+  std::string String;
+  double Number = 0.0;
+  bool Boolean = false;
+  std::vector<ScenarioValue> Array;
+};
+
+static std::string Trim(const std::string& text)
+{
+  std::size_t start = text.find_first_not_of(" \t\r\n");
+  if (start == std::string::npos) return "";
+  std::size_t end = text.find_last_not_of(" \t\r\n");
+  return text.substr(start, end - start + 1);
+}
+
+// Removes a trailing comment, leaving any # inside of strings alone
+static std::string StripComment(const std::string& line)
+{
+  bool inString = false;
+  for (std::size_t i = 0; i < line.size(); i++)
+  {
+    if (line[i] == '"') inString = !inString;
+    else if (line[i] == '#' && !inString) return line.substr(0, i);
+  }
+  return line;
+}
+
+static int BracketDepth(const std::string& text)
+{
+  int depth = 0;
+  bool inString = false;
+  for (char c : text)
+  {
+    if (c == '"') inString = !inString;
+    else if (!inString && c == '[') depth++;
+    else if (!inString && c == ']') depth--;
+  }
+  return depth;
+}
+
+static bool ParseValue(const std::string& text, std::size_t& pos, ScenarioValue& value, std::string& error)
+{
+  auto skipSpace = [&]() { while (pos < text.size() && std::strchr(" \t\r\n", text[pos])) pos++; };
+  skipSpace();
+  if (pos >= text.size())
+  {
+    error = "missing value";
+    return false;
+  }
+
+  if (text[pos] == '"')
+  {
+    std::size_t end = text.find('"', pos + 1);
+    if (end == std::string::npos)
+    {
+      error = "unterminated string";
+      return false;
+    }
+    value.Type = ValueType::String;
+    value.String = text.substr(pos + 1, end - pos - 1);
+    pos = end + 1;
+    return true;
+  }
+
+  if (text[pos] == '[')
+  {
+    value.Type = ValueType::Array;
+    pos++;
+    while (true)
+    {
+      skipSpace();
+      if (pos < text.size() && text[pos] == ']') { pos++; return true; }
+
+      ScenarioValue element;
+      if (!ParseValue(text, pos, element, error)) return false;
+      value.Array.push_back(std::move(element));
+
+      // Elements are separated by commas, and a trailing comma is allowed
+      skipSpace();
+      if (pos < text.size() && text[pos] == ',') pos++;
+      else if (pos < text.size() && text[pos] == ']') { pos++; return true; }
+      else
+      {
+        error = "expected , or ] in array";
+        return false;
+      }
+    }
+  }
+
+  if (text.compare(pos, 4, "true") == 0 || text.compare(pos, 5, "false") == 0)
+  {
+    value.Type = ValueType::Boolean;
+    value.Boolean = text[pos] == 't';
+    pos += value.Boolean ? 4 : 5;
+    return true;
+  }
+
+  const char* start = text.c_str() + pos;
+  char* end = nullptr;
+  value.Type = ValueType::Number;
+  value.Number = std::strtod(start, &end);
+  if (end == start)
+  {
+    error = "unrecognized value '" + text.substr(pos) + "'";
+    return false;
+  }
+  pos += end - start;
+  return true;
+}
+
+static bool GetNumber(const ScenarioValue& value, double& number, std::string& error)
+{
+  if (value.Type != ValueType::Number)
+  {
+    error = "expected a number";
+    return false;
+  }
+  number = value.Number;
+  return true;
+}
+
+static bool GetCount(const ScenarioValue& value, std::size_t& count, std::string& error)
+{
+  double number = 0.0;
+  if (!GetNumber(value, number, error)) return false;
+  if (number < 0.0 || number != static_cast<double>(static_cast<std::size_t>(number)))
+  {
+    error = "expected a whole, positive number";
+    return false;
+  }
+  count = static_cast<std::size_t>(number);
+  return true;
+}
+
+static bool GetFloat(const ScenarioValue& value, float& result, std::string& error)
+{
+  double number = 0.0;
+  if (!GetNumber(value, number, error)) return false;
+  result = static_cast<float>(number);
+  return true;
+}
+
+static bool GetBoolean(const ScenarioValue& value, bool& result, std::string& error)
+{
+  if (value.Type != ValueType::Boolean)
+  {
+    error = "expected true or false";
+    return false;
+  }
+  result = value.Boolean;
+  return true;
+}
+
+static bool GetString(const ScenarioValue& value, std::string& result, std::string& error)
+{
+  if (value.Type != ValueType::String)
+  {
+    error = "expected a string";
+    return false;
+  }
+  result = value.String;
+  return true;
+}
+
+// Flattens the rows of the matrix into a single list of scales
+static bool GetScales(const ScenarioValue& value, std::vector<float>& scales, std::string& error)
+{
+  if (value.Type == ValueType::Array)
+  {
+    for (const ScenarioValue& element : value.Array)
+      if (!GetScales(element, scales, error)) return false;
+    return true;
+  }
+
+  float scale = 0.0f;
+  if (!GetFloat(value, scale, error)) return false;
+  scales.push_back(scale);
+  return true;
+}
+
+static bool ApplyKey(Scenario& scenario, const std::string& key, const ScenarioValue& value, std::string& error)
+{
+  std::string text;
+  std::size_t seed = 0;
+
+  if (key == "name") return GetString(value, scenario.Name, error);
+  if (key == "size") return GetFloat(value, scenario.Size, error);
+  if (key == "particles") return GetCount(value, scenario.NumParticles, error);
+  if (key == "colors") return GetCount(value, scenario.NumColors, error);
+  if (key == "interaction_radius") return GetFloat(value, scenario.InteractionRadius, error);
+  if (key == "steps") return GetCount(value, scenario.NumSteps, error);
+  if (key == "warmup") return GetCount(value, scenario.NumWarmup, error);
+  if (key == "timestep") return GetFloat(value, scenario.Timestep, error);
+  if (key == "seed")
+  {
+    if (!GetCount(value, seed, error)) return false;
+    scenario.Seed = static_cast<std::uint32_t>(seed);
+    return true;
+  }
+  if (key == "boundary")
+  {
+    if (!GetString(value, text, error)) return false;
+    if (text == "periodic") scenario.Boundary = BoundaryMode::Periodic;
+    else if (text == "reflective") scenario.Boundary = BoundaryMode::Reflective;
+    else if (text == "open") scenario.Boundary = BoundaryMode::Open;
+    else
+    {
+      error = "boundary must be periodic, reflective or open";
+      return false;
+    }
+    return true;
+  }
+  if (key == "checksum")
+  {
+    // A string, since TOML integers can't hold all 64 bits
+    if (!GetString(value, text, error)) return false;
+    char* end = nullptr;
+    scenario.Checksum = std::strtoull(text.c_str(), &end, 16);
+    scenario.HasChecksum = true;
+    if (text.empty() || *end != '\0')
+    {
+      error = "checksum must be a hexadecimal string";
+      return false;
+    }
+    return true;
+  }
+
+  if (key == "engine.multithreaded") return GetBoolean(value, scenario.Multithreaded, error);
+  if (key == "engine.tabulated") return GetBoolean(value, scenario.Tabulated, error);
+  if (key == "engine.sleeping") return GetBoolean(value, scenario.Sleeping, error);
+
+  if (key == "spawn.distribution")
+  {
+    if (!GetString(value, text, error)) return false;
+    if (text == "uniform") scenario.Spawn = SpawnDistribution::Uniform;
+    else if (text == "clusters") scenario.Spawn = SpawnDistribution::Clusters;
+    else if (text == "gaussian") scenario.Spawn = SpawnDistribution::Gaussian;
+    else
+    {
+      error = "distribution must be uniform, clusters or gaussian";
+      return false;
+    }
+    return true;
+  }
+  if (key == "spawn.clusters") return GetCount(value, scenario.NumClusters, error);
+  if (key == "spawn.spread") return GetFloat(value, scenario.Spread, error);
+
+  if (key == "matrix.scales")
+  {
+    scenario.Matrix.clear();
+    return GetScales(value, scenario.Matrix, error);
+  }
+
+  // Catch typos, rather than quietly running something else
+  error = "unknown key";
+  return false;
+}
+
+bool LoadScenario(const std::string& path, Scenario& scenario, std::string& error)
+{
+  std::ifstream file(path);
+  if (!file.is_open())
+  {
+    error = path + ": could not open file";
+    return false;
+  }
+
+  scenario = Scenario();
+  std::string section, line, statement;
+  std::size_t lineNumber = 0, statementLine = 0;
+  while (std::getline(file, line))
+  {
+    lineNumber++;
+    line = Trim(StripComment(line));
+    if (line.empty()) continue;
+
+    // Arrays can continue over several lines, so gather them into one statement
+    if (statement.empty()) statementLine = lineNumber;
+    statement += statement.empty() ? line : " " + line;
+    if (BracketDepth(statement) > 0 && statement.find('=') != std::string::npos) continue;
+
+    std::string location = path + ":" + std::to_string(statementLine) + ": ";
+    if (statement.front() == '[')
+    {
+      if (statement.back() != ']')
+      {
+        error = location + "malformed table header";
+        return false;
+      }
+      section = Trim(statement.substr(1, statement.size() - 2));
+      statement.clear();
+      continue;
+    }
+
+    std::size_t equals = statement.find('=');
+    if (equals == std::string::npos)
+    {
+      error = location + "expected key = value";
+      return false;
+    }
+
+    std::string key = Trim(statement.substr(0, equals));
+    if (!section.empty()) key = section + "." + key;
+
+    ScenarioValue value;
+    std::size_t pos = equals + 1;
+    if (!ParseValue(statement, pos, value, error) || !Trim(statement.substr(pos)).empty())
+    {
+      if (error.empty()) error = "unexpected text after value";
+      error = location + key + ": " + error;
+      return false;
+    }
+    if (!ApplyKey(scenario, key, value, error))
+    {
+      error = location + key + ": " + error;
+      return false;
+    }
+    statement.clear();
+  }
+
+  if (!statement.empty())
+  {
+    error = path + ":" + std::to_string(statementLine) + ": unterminated array";
+    return false;
+  }
+
+  // Check that the scenario can actually run
+  if (scenario.Name.empty())
+    scenario.Name = path;
+  if (scenario.NumColors == 0 || scenario.NumParticles == 0 || scenario.NumSteps == 0)
+    error = "particles, colors and steps must be at least 1";
+  else if (scenario.Size <= 0.0f || scenario.InteractionRadius <= 0.0f || scenario.InteractionRadius > scenario.Size / 2.0f)
+    error = "interaction_radius must be positive and at most half of size";
+  else if (scenario.NumParticles > s_MaxParticles || scenario.NumColors > s_MaxColors)
+    error = "too many particles or colors";
+  else if (scenario.Timestep <= 0.0f)
+    error = "timestep must be positive";
+  else if (!scenario.Matrix.empty() && scenario.Matrix.size() != scenario.NumColors * scenario.NumColors)
+    error = "matrix.scales must have colors * colors entries";
+  else if (scenario.Spawn == SpawnDistribution::Clusters && scenario.NumClusters == 0)
+    error = "spawn.clusters must be at least 1";
+
+  if (!error.empty())
+  {
+    error = path + ": " + error;
+    return false;
+  }
+  return true;
+}
+
+// The standard distributions are free to differ between standard libraries, but mt19937's raw output
+// is the same everywhere, so scenarios map it to their values themselves.
+
+// In [min, max), from the top 24 bits, which a float holds exactly.
+static float UniformFloat(std::mt19937& generator, float min, float max)
+{
+  float t = static_cast<float>(generator() >> 8) * (1.0f / 16777216.0f);
+  return min + (max - min) * t;
+}
+
+// In [0, count), by scaling rather than the modulo, which is biased towards the low values.
+static std::size_t UniformIndex(std::mt19937& generator, std::size_t count)
+{
+  return static_cast<std::size_t>((static_cast<std::uint64_t>(generator()) * count) >> 32);
+}
+
+// Box-Muller, keeping only one of the pair. It is computed in double, so the last bits that
+// libm implementations may disagree on are rounded away when converting to float.
+static float Normal(std::mt19937& generator, float mean, float deviation)
+{
+  double u1 = (static_cast<double>(generator()) + 1.0) / 4294967296.0; // (0, 1], so the log is finite
+  double u2 = static_cast<double>(generator()) / 4294967296.0;
+  double z = std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * 3.14159265358979323846 * u2);
+  return mean + deviation * static_cast<float>(z);
+}
+
+void SetupScenario(const Scenario& scenario, System& system, ColorMatrix& matrix)
+{
+  // Each scenario gets its own generator, so the results don't depend on what ran before
+  std::mt19937 generator(scenario.Seed);
+
+  matrix = ColorMatrix(static_cast<int>(scenario.NumColors));
+  for (std::size_t i = 0; i < scenario.NumColors; i++)
+  {
+    for (std::size_t j = 0; j < scenario.NumColors; j++)
+    {
+      // Same distribution as a random ColorMatrix, but from our seed
+      float scale = glm::clamp(Normal(generator, 0.0f, 0.5f), -1.0f, 1.0f);
+      if (!scenario.Matrix.empty()) scale = scenario.Matrix[i * scenario.NumColors + j];
+      matrix.SetAttractionScale(i, j, scale);
+    }
+  }
+
+  system.SetInteractionRadius(scenario.InteractionRadius);
+  system.SetBoundingBoxSize(scenario.Size);
+  system.SetBoundaryMode(scenario.Boundary);
+  system.SetNumParticles(scenario.NumParticles, scenario.NumColors);
+  system.SetSleeping(scenario.Sleeping);
+
+  // Place every particle ourselves, the system would use the global generator. Every draw is its
+  // own statement, since the order function arguments are evaluated in isn't specified.
+  float size = scenario.Size;
+  std::vector<glm::vec2> centers(scenario.Spawn == SpawnDistribution::Clusters ? scenario.NumClusters : 1, glm::vec2(0.0f));
+  if (scenario.Spawn == SpawnDistribution::Clusters)
+  {
+    for (glm::vec2& center : centers)
+    {
+      center.x = UniformFloat(generator, -size, size);
+      center.y = UniformFloat(generator, -size, size);
+    }
+  }
+
+  for (Particle& particle : system.GetParticles())
+  {
+    glm::vec2 position;
+    if (scenario.Spawn == SpawnDistribution::Uniform)
+    {
+      position.x = UniformFloat(generator, -size, size);
+      position.y = UniformFloat(generator, -size, size);
+    }
+    else
+    {
+      position = centers[UniformIndex(generator, centers.size())];
+      position.x += Normal(generator, 0.0f, scenario.Spread);
+      position.y += Normal(generator, 0.0f, scenario.Spread);
+    }
+
+    // Keep the blobs inside of the system, just short of the far edge
+    position = glm::clamp(position, glm::vec2(-size), glm::vec2(size * 0.9999f));
+
+    particle.Position = position;
+    particle.LastPosition = position;
+    particle.NetForce = {0.0f, 0.0f};
+    particle.Color = static_cast<ColorIndex>(UniformIndex(generator, scenario.NumColors));
+  }
+
+  system.PartitionsParticles();
+}
+
+std::uint64_t ChecksumParticles(const std::vector<Particle>& particles)
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  auto combine = [&](const void* data, std::size_t size)
+  {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; i++)
+    {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+  };
+
+  for (const Particle& particle : particles)
+  {
+    std::uint64_t color = particle.Color;
+    combine(&particle.Position.x, sizeof(float));
+    combine(&particle.Position.y, sizeof(float));
+    combine(&color, sizeof(color));
+  }
+  return hash;
+}
+
+}
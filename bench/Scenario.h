@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "simulation/System.h"
+#include "simulation/ColorMatrix.h"
+
+namespace Speck
+{
+
+enum class SpawnDistribution
+{
+  Uniform,  // evenly over the whole system
+  Clusters, // gaussian blobs around random centers
+  Gaussian  // a single gaussian blob in the middle
+};
+
+/// Everything needed to rebuild the same starting state and run it again. Scenarios are
+/// loaded from a small subset of TOML, see the files in the scenarios directory.
+struct Scenario
+{
+  std::string Name;
+
+  // System
+  float Size = 100.0f;
+  std::size_t NumParticles = 1000;
+  std::size_t NumColors = 5;
+  float InteractionRadius = 40.0f;
+  BoundaryMode Boundary = BoundaryMode::Periodic;
+
+  // Run
+  std::size_t NumSteps = 100;
+  std::size_t NumWarmup = 10;
+  float Timestep = 1.0f / 60.0f;
+  std::uint32_t Seed = 1;
+
+  // Engine
+  bool Multithreaded = true;
+  bool Tabulated = false;
+  bool Sleeping = false;
+
+  // Spawn
+  SpawnDistribution Spawn = SpawnDistribution::Uniform;
+  std::size_t NumClusters = 8;
+  float Spread = 10.0f; // standard deviation of the blobs
+
+  // Attraction scales, row by row. Randomized from the seed when empty.
+  std::vector<float> Matrix;
+
+  // Checksum of the final positions, only checked when given.
+  bool HasChecksum = false;
+  std::uint64_t Checksum = 0;
+};
+
+// Returns false and describes the problem in error if the file can't be used.
+bool LoadScenario(const std::string& path, Scenario& scenario, std::string& error);
+
+// Puts the system and matrix in the scenario's starting state. Everything random comes from the scenario's seed.
+void SetupScenario(const Scenario& scenario, System& system, ColorMatrix& matrix);
+
+// FNV-1a over the particles' positions and colors, in order.
+std::uint64_t ChecksumParticles(const std::vector<Particle>& particles);
+
+}
@@ -0,0 +1,215 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+#include "Scenario.h"
+#include "simulation/ColorForce.h"
+#include "simulation/FrictionForce.h"
+#include "simulation/Observables.h"
+
+using namespace Speck;
+
+// The stages of Specks::OnUpdate, timed separately
+enum Stage
+{
+  ZeroForces, ColorForces, FrictionForces, Integrate, Boundary, Partition, NumStages
+};
+
+static const char* s_StageNames[NumStages] = { "zero forces", "color force", "friction", "integrate", "boundary", "partition" };
+
+// Where and how observables are recorded, when they are asked for
+struct ObserveOptions
+{
+  std::filesystem::path Directory; // empty when not observing
+  SinkFormat Format = SinkFormat::CSV;
+  std::size_t SampleInterval = Observables::s_DefaultSampleInterval;
+};
+
+struct ScenarioResult
+{
+  std::string Name;
+  double StageMs[NumStages] = {};
+  double TotalMs = 0.0;
+  std::size_t NumParticles = 0;
+  std::uint64_t Checksum = 0;
+  bool Passed = true;
+};
+
+// Runs a stage, adding its time to the total when timed
+template <typename Func>
+static void TimeStage(double* stageMs, Stage stage, Func func)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  func();
+  auto end = std::chrono::high_resolution_clock::now();
+  if (stageMs) stageMs[stage] += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static void Step(System& system, ColorForce& colorForce, FrictionForce& frictionForce, const ColorMatrix& matrix, float timestep, double* stageMs)
+{
+  TimeStage(stageMs, ZeroForces, [&]() { system.ZeroForces(); });
+  TimeStage(stageMs, ColorForces, [&]() { colorForce.ApplyForces(&system, matrix, timestep); });
+  TimeStage(stageMs, FrictionForces, [&]() { frictionForce.ApplyForces(&system, timestep); });
+  TimeStage(stageMs, Integrate, [&]() { system.UpdatePositions(timestep); });
+  TimeStage(stageMs, Boundary, [&]() { system.ApplyBoundary(); });
+  TimeStage(stageMs, Partition, [&]() { system.PartitionsParticles(); });
+}
+
+static ScenarioResult RunScenario(const Scenario& scenario, const ObserveOptions& observe)
+{
+  ScenarioResult result;
+  result.Name = scenario.Name;
+
+  System system(0, scenario.NumColors, scenario.Size);
+  ColorMatrix matrix;
+  SetupScenario(scenario, system, matrix);
+
+  ColorForce colorForce;
+  colorForce.SetMultiThreaded(scenario.Multithreaded);
+  colorForce.SetTabulated(scenario.Tabulated);
+  FrictionForce frictionForce;
+
+  const char* boundaryNames[] = { "periodic", "reflective", "open" };
+  std::printf("%s: %zu particles, %zu colors, size %.0f, radius %.1f, %s, %zu steps\n", scenario.Name.c_str(), scenario.NumParticles,
+              scenario.NumColors, scenario.Size, scenario.InteractionRadius, boundaryNames[static_cast<int>(scenario.Boundary)], scenario.NumSteps);
+
+  for (std::size_t i = 0; i < scenario.NumWarmup; i++)
+    Step(system, colorForce, frictionForce, matrix, scenario.Timestep, nullptr);
+
+  // Only the timed steps are recorded. Observing doesn't change the particles, so the checksum still holds.
+  Observables observables;
+  if (!observe.Directory.empty())
+  {
+    std::string path = (observe.Directory / scenario.Name).string() + (observe.Format == SinkFormat::CSV ? ".csv" : ".bin");
+    if (observables.OpenSink(path, observe.Format))
+    {
+      observables.SetEnabled(true);
+      observables.SetSampleInterval(observe.SampleInterval);
+      colorForce.SetObservables(&observables);
+      std::printf("  observables  %s, %s\n", path.c_str(), Observables::GetPairSinkPath(path).c_str());
+    }
+    else
+    {
+      std::printf("  FAILED to open %s\n", path.c_str());
+      result.Passed = false;
+    }
+  }
+  for (std::size_t i = 0; i < scenario.NumSteps; i++)
+    Step(system, colorForce, frictionForce, matrix, scenario.Timestep, result.StageMs);
+
+  for (double& ms : result.StageMs)
+  {
+    ms /= static_cast<double>(scenario.NumSteps);
+    result.TotalMs += ms;
+  }
+
+  for (int stage = 0; stage < NumStages; stage++)
+  {
+    double percent = result.TotalMs > 0.0 ? 100.0 * result.StageMs[stage] / result.TotalMs : 0.0;
+    std::printf("  %-12s %9.3fms %5.1f%%\n", s_StageNames[stage], result.StageMs[stage], percent);
+  }
+  std::printf("  %-12s %9.3fms per step\n", "total", result.TotalMs);
+
+  // The checksum covers the order of the particles too, open boundaries reorder them when removing
+  result.NumParticles = system.GetParticles().size();
+  result.Checksum = ChecksumParticles(system.GetParticles());
+  std::printf("  checksum     %016llx (%zu particles)", static_cast<unsigned long long>(result.Checksum), result.NumParticles);
+  if (scenario.HasChecksum)
+  {
+    result.Passed = result.Checksum == scenario.Checksum;
+    std::printf(result.Passed ? ", matches" : ", MISMATCH (expected %016llx)", static_cast<unsigned long long>(scenario.Checksum));
+  }
+  std::printf("\n\n");
+
+  return result;
+}
+
+// Usage: SpecksScenarios [--steps n] [--observe directory [--binary] [--interval n]] [directories or .toml files...]
+// Runs every scenario headless, defaulting to the scenarios directory. With --observe, the observables
+// of every scenario are streamed to files named after it, and the stage timings include measuring them.
+int main(int argc, char** argv)
+{
+  std::vector<std::filesystem::path> paths;
+  std::size_t stepsOverride = 0;
+  ObserveOptions observe;
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+      stepsOverride = std::strtoul(argv[++i], nullptr, 10);
+    else if (std::strcmp(argv[i], "--observe") == 0 && i + 1 < argc)
+      observe.Directory = argv[++i];
+    else if (std::strcmp(argv[i], "--binary") == 0)
+      observe.Format = SinkFormat::Binary;
+    else if (std::strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+      observe.SampleInterval = std::strtoul(argv[++i], nullptr, 10);
+    else
+      paths.push_back(argv[i]);
+  }
+  if (paths.empty()) paths.push_back("scenarios");
+
+  if (!observe.Directory.empty())
+  {
+    std::error_code errorCode;
+    std::filesystem::create_directories(observe.Directory, errorCode);
+  }
+
+  // Expand directories, sorted so runs are always in the same order
+  std::vector<std::filesystem::path> files;
+  for (const std::filesystem::path& path : paths)
+  {
+    std::error_code errorCode;
+    if (!std::filesystem::is_directory(path, errorCode))
+    {
+      files.push_back(path);
+      continue;
+    }
+
+    std::vector<std::filesystem::path> directoryFiles;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(path, errorCode))
+      if (entry.is_regular_file() && entry.path().extension() == ".toml") directoryFiles.push_back(entry.path());
+    std::sort(directoryFiles.begin(), directoryFiles.end());
+    files.insert(files.end(), directoryFiles.begin(), directoryFiles.end());
+  }
+
+  if (files.empty())
+  {
+    std::printf("No scenarios found\n");
+    return 1;
+  }
+
+  bool passed = true;
+  std::vector<ScenarioResult> results;
+  for (const std::filesystem::path& file : files)
+  {
+    Scenario scenario;
+    std::string error;
+    if (!LoadScenario(file.string(), scenario, error))
+    {
+      std::printf("FAILED to load %s\n\n", error.c_str());
+      passed = false;
+      continue;
+    }
+    // The recorded checksum is only for the scenario's own step count
+    if (stepsOverride > 0 && stepsOverride != scenario.NumSteps)
+    {
+      scenario.NumSteps = stepsOverride;
+      scenario.HasChecksum = false;
+    }
+
+    results.push_back(RunScenario(scenario, observe));
+    passed &= results.back().Passed;
+  }
+
+  // One line per scenario, easy to diff between runs
+  std::printf("%-32s %12s %12s  %s\n", "scenario", "ms/step", "force ms", "checksum");
+  for (const ScenarioResult& result : results)
+  {
+    std::printf("%-32s %12.3f %12.3f  %016llx%s\n", result.Name.c_str(), result.TotalMs, result.StageMs[ColorForces],
+                static_cast<unsigned long long>(result.Checksum), result.Passed ? "" : " MISMATCH");
+  }
+
+  return passed ? 0 : 1;
+}
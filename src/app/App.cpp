@@ -1,11 +1,16 @@
 #include "App.h"
 
+#include <chrono>
+#include <climits>
+#include <algorithm>
 #include <imgui.h>
 #include <glm/gtc/random.hpp>
 
 #include "core/Input.h"
 #include "ui/Settings.h"
 
+#include "simulation/SpatialQuery.h"
+
 namespace Speck
 {
 
@@ -20,12 +25,17 @@ Specks::Specks()
 
   // Setup the particle system
   m_System = new System(500, 5, 100.0f);
-  m_ColorMatrix = ColorMatrix(5);
-  m_ColorMatrix.SetColor(0, {1.0f, 1.0f, 0.0f, 1.0f});
-  m_ColorMatrix.SetColor(1, {0.0f, 1.0f, 1.0f, 1.0f});
-  m_ColorMatrix.SetColor(2, {1.0f, 0.0f, 1.0f, 1.0f});
-  m_ColorMatrix.SetColor(3, {0.5f, 1.0f, 0.8f, 1.0f});
-  m_ColorMatrix.SetColor(4, {0.8f, 0.2f, 0.5f, 1.0f});
+  ColorMatrix& matrix = m_ColorMatrix.Edit();
+  matrix = ColorMatrix(5);
+  matrix.SetColor(0, {1.0f, 1.0f, 0.0f, 1.0f});
+  matrix.SetColor(1, {0.0f, 1.0f, 1.0f, 1.0f});
+  matrix.SetColor(2, {1.0f, 0.0f, 1.0f, 1.0f});
+  matrix.SetColor(3, {0.5f, 1.0f, 0.8f, 1.0f});
+  matrix.SetColor(4, {0.8f, 0.2f, 0.5f, 1.0f});
+  m_ColorMatrix.Publish();
+
+  // Observables are measured by the color force
+  m_ColorForce.SetObservables(&m_Observables);
 }
 
 Specks::~Specks()
@@ -43,18 +53,46 @@ void Specks::OnUpdate(float timestep)
   if (Vision::Input::KeyPress(SDL_SCANCODE_RETURN)) m_UpdateSystem = !m_UpdateSystem;
   if (m_UpdateSystem)
   {
-    m_System->PartitionsParticles();
+    // Matrix edits only take effect between steps, so the force workers never see a half edited matrix
+    m_ColorMatrix.Publish();
+
+    // Settled particles won't notice a new matrix by themselves
+    if (m_ColorMatrix.GetVersion() != m_MatrixVersion)
+    {
+      m_MatrixVersion = m_ColorMatrix.GetVersion();
+      m_System->WakeAll();
+    }
 
     m_System->ZeroForces();
-    m_ColorForce.ApplyForces(m_System, m_ColorMatrix, timestep);
+    m_ColorForce.ApplyForces(m_System, m_ColorMatrix.GetActive(), timestep);
     m_FrictionForce.ApplyForces(m_System, timestep);
 
   	m_System->UpdatePositions(timestep);
-    m_System->WrapPositions();
+    m_System->ApplyBoundary();
+
+    // Partition at the end of the step, so the cells match the positions when we query them
+    m_System->PartitionsParticles();
+  }
+
+  // Removing particles swaps others into their slots, so an index we hold may now be a different particle
+  std::size_t numParticles = m_System->GetParticles().size();
+  if (numParticles < m_NumParticles)
+  {
+    m_HoveredParticle = SpatialQuery::s_NoParticle;
+    m_TrackedParticle = SpatialQuery::s_NoParticle;
   }
+  m_NumParticles = numParticles;
   
   // Update the camera system
   m_Camera->Update(timestep);
+
+  // Follow the tracked particle, keeping our zoom
+  if (m_TrackedParticle < m_System->GetParticles().size())
+  {
+    glm::vec2 position = m_System->GetParticles()[m_TrackedParticle].Position;
+    glm::vec3 cameraPosition = m_Camera->GetPosition();
+    m_Camera->SetPosition({position.x, position.y, cameraPosition.z});
+  }
   
   // Clear the screen
   glClearColor(0.2f, 0.2f, 0.25f, 1.0f);
@@ -66,12 +104,19 @@ void Specks::OnUpdate(float timestep)
   m_Renderer->DrawSquare({0.0f, 0.0f}, { 0.1f, 0.1f, 0.1f, 1.0f }, m_System->GetBoundingBoxSize());
 
   std::vector<Particle>& particles = m_System->GetParticles();
+  const ColorMatrix& activeMatrix = m_ColorMatrix.GetActive();
   for (std::size_t i = 0; i < particles.size(); ++i)
   {
     Particle& particle = particles[i];
-    m_Renderer->DrawPoint(particle.Position, m_ColorMatrix.GetColor(particle.Color), 1.0f);
+    m_Renderer->DrawPoint(particle.Position, activeMatrix.GetColor(particle.Color), 1.0f);
   }
 
+  // Highlight the particles we are inspecting
+  if (m_HoveredParticle < particles.size())
+    m_Renderer->DrawPoint(particles[m_HoveredParticle].Position, {1.0f, 1.0f, 1.0f, 1.0f}, 2.0f);
+  if (m_TrackedParticle < particles.size())
+    m_Renderer->DrawPoint(particles[m_TrackedParticle].Position, {1.0f, 1.0f, 1.0f, 1.0f}, 3.0f);
+
   m_Renderer->End();
   
   DisplayUI(timestep);
@@ -95,17 +140,32 @@ void Specks::DisplayUI(float timestep)
       UI::DisplayColorMatrix(m_ColorMatrix);
 
       ImGui::SameLine();
-      if (ImGui::Button("Randomize"))
+      ImGui::BeginGroup();
+      bool randomize = ImGui::Button("Randomize");
+      bool morph = ImGui::Button("Morph to Random");
+      ImGui::PushItemWidth(ImGui::GetFontSize() * 6);
+      ImGui::SliderInt("Morph Steps", &m_MorphSteps, 1, 600);
+      ImGui::PopItemWidth();
+      ImGui::EndGroup();
+
+      // Both edit the staged matrix, a morph then blends towards it over several steps
+      if (randomize || morph)
       {
-        std::size_t numColors = m_ColorMatrix.GetNumColors();
+        ColorMatrix& matrix = m_ColorMatrix.Edit();
+        std::size_t numColors = matrix.GetNumColors();
         for (std::size_t i = 0; i < numColors; i++)
         {
           for (std::size_t j = 0; j < numColors; j++)
           {
-            m_ColorMatrix.SetAttractionScale(i, j, glm::linearRand(-1.0f, 1.0f));
+            matrix.SetAttractionScale(i, j, glm::linearRand(-1.0f, 1.0f));
           }
         }
+
+        if (morph) m_ColorMatrix.Morph(static_cast<std::size_t>(m_MorphSteps));
       }
+
+      if (m_ColorMatrix.IsMorphing())
+        ImGui::ProgressBar(m_ColorMatrix.GetMorphProgress(), {-1.0f, 0.0f}, "Morphing");
     }
 
     // Simulation Settings UI
@@ -123,7 +183,16 @@ void Specks::DisplayUI(float timestep)
       if (ImGui::SliderFloat("Simulation Size", &boundingSize, interactionRadius, 500.0f, "%.1f"))
         m_System->SetBoundingBoxSize(boundingSize);
       if (ImGui::InputInt("Number of Particles", &numParticles))
-        m_System->SetNumParticles(static_cast<std::size_t>(numParticles), m_ColorMatrix.GetNumColors());
+      {
+        // InputInt happily goes negative, and an int can't reach the index limit anyway
+        numParticles = std::clamp(numParticles, 0, static_cast<int>(std::min<std::size_t>(s_MaxParticles, INT_MAX)));
+        m_System->SetNumParticles(static_cast<std::size_t>(numParticles), m_ColorMatrix.GetActive().GetNumColors());
+      }
+
+      const char* boundaryModes[] = { "Periodic", "Reflective", "Open" };
+      int boundaryMode = static_cast<int>(m_System->GetBoundaryMode());
+      if (ImGui::Combo("Boundary", &boundaryMode, boundaryModes, IM_ARRAYSIZE(boundaryModes)))
+        m_System->SetBoundaryMode(static_cast<BoundaryMode>(boundaryMode));
     }
     ImGui::PopItemWidth();
 
@@ -139,10 +208,181 @@ void Specks::DisplayUI(float timestep)
       bool threaded = m_ColorForce.IsMultiThreaded();
       if (ImGui::Checkbox("Multithreaded", &threaded))
        m_ColorForce.SetMultiThreaded(threaded);
+
+      bool tabulated = m_ColorForce.IsTabulated();
+      if (ImGui::Checkbox("Tabulated Forces", &tabulated))
+        m_ColorForce.SetTabulated(tabulated);
+
+      bool sleeping = m_System->IsSleeping();
+      if (ImGui::Checkbox("Sleep Settled Cells", &sleeping))
+        m_System->SetSleeping(sleeping);
+
+      if (sleeping)
+      {
+        float displacement = m_System->GetSleepDisplacement();
+        float force = m_System->GetSleepForce();
+        ImGui::PushItemWidth(ImGui::GetFontSize() * -12);
+        if (ImGui::SliderFloat("Sleep Displacement", &displacement, 0.0f, 0.1f, "%.3f"))
+          m_System->SetSleepThresholds(displacement, force);
+        if (ImGui::SliderFloat("Sleep Force", &force, 0.0f, 0.5f, "%.3f"))
+          m_System->SetSleepThresholds(displacement, force);
+        ImGui::PopItemWidth();
+
+        ImGui::Text("Sleeping Cells: %zu / %zu", m_System->GetNumSleepingCells(), m_System->GetCells().size());
+      }
+    }
+
+    // Observables
+    ImGui::SeparatorText("Observables");
+    {
+      DisplayObservablesUI();
+    }
+
+    // Particle Inspection
+    ImGui::SeparatorText("Inspector");
+    {
+      DisplayInspectorUI();
     }
   }
   ImGui::End();
   m_UIRenderer->End();
 }
 
+void Specks::DisplayInspectorUI()
+{
+  std::vector<Particle>& particles = m_System->GetParticles();
+  SpatialQuery query(m_System);
+
+  // Only inspect the world when the cursor isn't over a window
+  m_HoveredParticle = SpatialQuery::s_NoParticle;
+  m_QueryResults.clear();
+  if (!ImGui::GetIO().WantCaptureMouse)
+  {
+    glm::vec2 cursor = GetCursorWorldPosition();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    m_HoveredParticle = query.Nearest(cursor, m_HoverRadius);
+    query.Radius(cursor, m_QueryRadius, m_QueryResults);
+    auto end = std::chrono::high_resolution_clock::now();
+    m_QueryTime = std::chrono::duration<float, std::milli>(end - start).count();
+
+    if (m_HoveredParticle != SpatialQuery::s_NoParticle)
+    {
+      const Particle& particle = particles[m_HoveredParticle];
+      glm::vec2 velocity = particle.Position - particle.LastPosition;
+
+      ImGui::BeginTooltip();
+      ImGui::Text("Particle %u", m_HoveredParticle);
+      ImGui::Text("Color: %u", static_cast<unsigned int>(particle.Color));
+      ImGui::Text("Position: (%.1f, %.1f)", particle.Position.x, particle.Position.y);
+      ImGui::Text("Velocity: (%.2f, %.2f)", velocity.x, velocity.y);
+      ImGui::EndTooltip();
+
+      if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+        m_TrackedParticle = m_HoveredParticle;
+    }
+  }
+
+  ImGui::PushItemWidth(ImGui::GetFontSize() * -12);
+  ImGui::SliderFloat("Query Radius", &m_QueryRadius, 1.0f, 100.0f, "%.1f");
+  ImGui::PopItemWidth();
+  ImGui::Text("Near Cursor: %zu particles (%.3fms)", m_QueryResults.size(), m_QueryTime);
+
+  if (m_TrackedParticle < particles.size())
+  {
+    ImGui::Text("Tracking: Particle %u", m_TrackedParticle);
+    ImGui::SameLine();
+    if (ImGui::Button("Stop Tracking")) m_TrackedParticle = SpatialQuery::s_NoParticle;
+  }
+  else
+  {
+    ImGui::Text("Click a particle to track it");
+  }
+}
+
+glm::vec2 Specks::GetCursorWorldPosition() const
+{
+  // Cast a ray from the camera through the cursor, and find where it hits the simulation plane (z = 0)
+  ImVec2 mouse = ImGui::GetIO().MousePos;
+  float x = 2.0f * mouse.x / static_cast<float>(m_DisplayWidth) - 1.0f;
+  float y = 1.0f - 2.0f * mouse.y / static_cast<float>(m_DisplayHeight);
+
+  glm::mat4 inverse = glm::inverse(m_Camera->GetViewProjectionMatrix());
+  glm::vec4 nearPoint = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+  glm::vec4 farPoint = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+  glm::vec3 start = glm::vec3(nearPoint) / nearPoint.w;
+  glm::vec3 end = glm::vec3(farPoint) / farPoint.w;
+
+  float t = start.z / (start.z - end.z);
+  return glm::vec2(start + t * (end - start));
+}
+
+void Specks::DisplayObservablesUI()
+{
+  bool enabled = m_Observables.IsEnabled();
+  if (ImGui::Checkbox("Measure", &enabled))
+    m_Observables.SetEnabled(enabled);
+
+  ImGui::SameLine();
+  bool recording = m_Observables.HasSink();
+  if (ImGui::Checkbox("Record (observables.csv, observables_pairs.csv)", &recording))
+  {
+    if (recording) m_Observables.OpenSink("observables.csv");
+    else m_Observables.CloseSink();
+  }
+
+  int interval = static_cast<int>(m_Observables.GetSampleInterval());
+  if (ImGui::SliderInt("Sample Interval", &interval, 1, 60))
+    m_Observables.SetSampleInterval(static_cast<std::size_t>(interval));
+
+  float clusterRadius = m_Observables.GetClusterRadius();
+  if (ImGui::SliderFloat("Cluster Radius", &clusterRadius, 0.05f, 1.0f, "%.2f"))
+    m_Observables.SetClusterRadius(clusterRadius);
+
+  const RingBuffer<ObservableSample>& history = m_Observables.GetHistory();
+  if (history.Empty()) return;
+
+  // Plot the kinetic energy over the recorded history
+  auto energyGetter = [](void* data, int index) -> float
+  {
+    const RingBuffer<ObservableSample>* history = static_cast<const RingBuffer<ObservableSample>*>(data);
+    return (*history)[index].KineticEnergy;
+  };
+  const ObservableSample& latest = history.Back();
+  ImGui::PlotLines("Kinetic Energy", energyGetter, (void*)&history, static_cast<int>(history.Size()), 0, nullptr, FLT_MAX, FLT_MAX, {0.0f, 60.0f});
+
+  ImGui::Text("Kinetic Energy: %.1f", latest.KineticEnergy);
+  ImGui::Text("Mean Neighbors: %.2f", latest.MeanNeighbors);
+  ImGui::Text("Clusters: %u (largest %u)", latest.NumClusters, latest.LargestCluster);
+
+  // Mean neighbor counts for each pair of colors
+  std::size_t colors = m_Observables.GetNumColors();
+  if (colors > 0 && ImGui::BeginTable("neighbor_matrix", static_cast<int>(colors) + 1, ImGuiTableFlags_Borders | ImGuiTableFlags_NoHostExtendX | ImGuiTableFlags_SizingFixedSame))
+  {
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    for (std::size_t column = 0; column < colors; column++)
+    {
+      ImGui::TableSetColumnIndex(static_cast<int>(column) + 1);
+      glm::vec4 col = m_ColorMatrix.GetActive().GetColor(column);
+      UI::Circle(6.0f, ImGui::GetColorU32({col.r, col.g, col.b, col.a}));
+    }
+
+    for (std::size_t row = 0; row < colors; row++)
+    {
+      ImGui::TableNextRow();
+      ImGui::TableSetColumnIndex(0);
+      glm::vec4 col = m_ColorMatrix.GetActive().GetColor(row);
+      UI::Circle(6.0f, ImGui::GetColorU32({col.r, col.g, col.b, col.a}));
+
+      for (std::size_t column = 0; column < colors; column++)
+      {
+        ImGui::TableSetColumnIndex(static_cast<int>(column) + 1);
+        ImGui::Text("%.1f", m_Observables.GetMeanNeighbors(row, column));
+      }
+    }
+    ImGui::EndTable();
+  }
+}
+
 }
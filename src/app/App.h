@@ -7,9 +7,11 @@
 #include "ui/ImGuiRenderer.h"
 
 #include "simulation/System.h"
-#include "simulation/ColorMatrix.h"
+#include "simulation/SharedColorMatrix.h"
 #include "simulation/ColorForce.h"
 #include "simulation/FrictionForce.h"
+#include "simulation/Observables.h"
+#include "simulation/SpatialQuery.h"
 
 namespace Speck
 {
@@ -25,6 +27,10 @@ public:
 
 private:
   void DisplayUI(float timestep);
+  void DisplayObservablesUI();
+  void DisplayInspectorUI();
+
+  glm::vec2 GetCursorWorldPosition() const;
   
 private:
   // Rendering
@@ -38,8 +44,22 @@ private:
 
   // Forces
   ColorForce m_ColorForce;
-  ColorMatrix m_ColorMatrix;
+  SharedColorMatrix m_ColorMatrix;
+  int m_MorphSteps = 120;
+  std::uint64_t m_MatrixVersion = 0; // the last version the system stepped with
   FrictionForce m_FrictionForce;
+
+  // Metrics
+  Observables m_Observables;
+
+  // Inspection
+  ParticleIndex m_HoveredParticle = SpatialQuery::s_NoParticle;
+  ParticleIndex m_TrackedParticle = SpatialQuery::s_NoParticle;
+  std::size_t m_NumParticles = 0; // the count the indices above were taken with
+  std::vector<ParticleIndex> m_QueryResults;
+  float m_HoverRadius = 2.0f;
+  float m_QueryRadius = 20.0f;
+  float m_QueryTime = 0.0f;
 };
 
 }
@@ -0,0 +1,61 @@
+#include "AllocationCounter.h"
+
+#ifdef SPECKS_COUNT_ALLOCATIONS
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+namespace
+{
+  std::atomic<std::size_t> s_AllocationCount = 0;
+
+  void* CountedAllocate(std::size_t size, std::size_t alignment = 0)
+  {
+    s_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+
+    void* memory = nullptr;
+    if (alignment > alignof(std::max_align_t))
+      memory = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    else
+      memory = std::malloc(size);
+
+    if (!memory) throw std::bad_alloc();
+    return memory;
+  }
+}
+
+void* operator new(std::size_t size) { return CountedAllocate(size); }
+void* operator new[](std::size_t size) { return CountedAllocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return CountedAllocate(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return CountedAllocate(size, static_cast<std::size_t>(alignment)); }
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+namespace Speck::Debug
+{
+
+bool IsCountingAllocations() { return true; }
+std::size_t GetAllocationCount() { return s_AllocationCount.load(std::memory_order_relaxed); }
+
+}
+
+#else
+
+namespace Speck::Debug
+{
+
+bool IsCountingAllocations() { return false; }
+std::size_t GetAllocationCount() { return 0; }
+
+}
+
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Speck::Debug
+{
+
+// When built with SPECKS_COUNT_ALLOCATIONS, the global operator new is replaced to count
+// every heap allocation. Otherwise, the count is always zero.
+bool IsCountingAllocations();
+std::size_t GetAllocationCount();
+
+}
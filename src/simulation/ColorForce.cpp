@@ -1,8 +1,7 @@
 #include "ColorForce.h"
 
-#include <thread>
-
 #include "System.h"
+#include "Observables.h"
 
 namespace Speck
 {
@@ -11,129 +10,125 @@ glm::vec2 ColorForce::ForceFunction(const Particle& particle, const Particle& ot
 {
   float systemSize = system->GetBoundingBoxSize();
   float systemInteractionRadius = system->GetInteractionRadius();
-
-  // Get the direction towards other particle, accounting for boundary wrapping.
+  float attractionScale = matrix.GetAttractionScale(particle.Color, other.Color);
   glm::vec2 delta = other.Position - particle.Position;
-  if (delta.x > systemSize) delta.x -= 2.0f  * systemSize;
-  if (delta.x < -systemSize) delta.x += 2.0f * systemSize;
-  if (delta.y > systemSize) delta.y -= 2.0f  * systemSize;
-  if (delta.y < -systemSize) delta.y += 2.0f * systemSize;
-  
-  float distance = glm::length(delta);
-  
-  // An interesting consequence of non-inverse-square law repulsion 
-  // is that it minimizes potential energy to create pockets instead of uniform particles.
-  // We may want a more physically accurate simulation in the future, that accounts for the
-  // total energy in the system.
-  if (distance <= m_RepulsionRadius * systemInteractionRadius)
-  {
-    float forceStrength = (distance / m_RepulsionRadius - systemInteractionRadius);
-    glm::vec2 dir = delta / distance;
-    return forceStrength * dir;
-  }
-  else if (distance <= systemInteractionRadius)
-  {
-    float forceStrength = systemInteractionRadius - glm::abs((2.0f * distance - systemInteractionRadius - m_RepulsionRadius * systemInteractionRadius) / (1.0f - m_RepulsionRadius));
-    forceStrength *= matrix.GetAttractionScale(particle.Color, other.Color);
-    glm::vec2 dir = delta / distance;
-    
-    return forceStrength * dir;
-  }
+
+  if (system->GetBoundaryMode() == BoundaryMode::Periodic)
+    return PairForce<true>(delta, systemSize, systemInteractionRadius, m_RepulsionRadius, attractionScale);
   else
-  {
-    return { 0.0f, 0.0f };
-  }
+    return PairForce<false>(delta, systemSize, systemInteractionRadius, m_RepulsionRadius, attractionScale);
 }
 
-void ColorForce::ApplyForces(System* system, const ColorMatrix& matrix, float timestep)
+GridIndex* ColorForce::BuildNeighborTable(System* system, bool periodic)
 {
-  std::vector<Particle>& particles = system->GetParticles();
-  std::size_t cellsAcross = system->GetCellsAcross();
-  std::vector<Cell> &cells = system->GetCells();
+  GridIndex cellsAcross = static_cast<GridIndex>(system->GetCellsAcross());
+  std::size_t numCells = system->GetCells().size();
+  GridIndex* neighbors = system->GetFrameArena().Allocate<GridIndex>(numCells * s_NumNeighbors);
 
-  // Thread Job Function (We only write to our specified particle[i].netforce and never read it, so there's no need for locks)
-  auto jobFunc = [&](std::size_t start, std::size_t end, float timestep)
+  for (std::size_t cellIndex = 0; cellIndex < numCells; cellIndex++)
   {
-    for (std::size_t i = start; i <= end; i++)
+    // Find the x and y of our current cell
+    GridIndex cellX = static_cast<GridIndex>(cellIndex % cellsAcross);
+    GridIndex cellY = static_cast<GridIndex>(cellIndex / cellsAcross); // integer division
+
+    // Find the neighboring columns and rows, wrapping around the edges. Everything stays unsigned.
+    GridIndex left = (cellX != 0) ? cellX - 1 : cellsAcross - 1;
+    GridIndex right = (cellX != cellsAcross - 1) ? cellX + 1 : 0;
+    GridIndex up = ((cellY != 0) ? cellY - 1 : cellsAcross - 1) * cellsAcross;
+    GridIndex row = cellY * cellsAcross;
+    GridIndex down = ((cellY != cellsAcross - 1) ? cellY + 1 : 0) * cellsAcross;
+
+    // Create our list from the rows and columns around us
+    GridIndex* list = neighbors + cellIndex * s_NumNeighbors;
+    list[0] = up + left;
+    list[1] = up + cellX;
+    list[2] = up + right;
+    list[3] = row + left;
+    list[4] = row + cellX;
+    list[5] = row + right;
+    list[6] = down + left;
+    list[7] = down + cellX;
+    list[8] = down + right;
+
+    // Without wrapping, the neighbors past the edges don't exist
+    if (!periodic)
     {
-      Particle &particle = particles[i];
-
-      // Create a list of neighboring cells
-      constexpr std::size_t numNeighbors = 9;
-      std::size_t neighbors[numNeighbors];
-      {
-        // Find the x and y of our current cell
-        int32_t cell = particle.CellIndex;
-        int32_t cellX = particle.CellIndex % cellsAcross;
-        int32_t cellY = particle.CellIndex / cellsAcross; // integer division
-
-        // Find the value we add to the cell's index to move in a certain direction, accounting for wrapping
-        int32_t ld = (cellX != 0) ? -1 : (cellsAcross - 1);                                                                   // if on left, add the size of grid
-        int32_t rd = (cellX != cellsAcross - 1) ? 1 : -static_cast<int32_t>(cellsAcross - 1);                               // if on right, subtract size of grid
-        int32_t ud = (cellY != 0) ? -cellsAcross : (cellsAcross * (cellsAcross - 1));                                     // if on top, add size of grid
-        int32_t dd = (cellY != cellsAcross - 1) ? cellsAcross : -static_cast<int32_t>(cellsAcross * (cellsAcross - 1)); // if on bottom, subtract size of grid
-        // Create our list by moving our cell's index in all of these directions
-        neighbors[0] = particle.CellIndex + ld + ud;
-        neighbors[1] = particle.CellIndex + ud;
-        neighbors[2] = particle.CellIndex + rd + ud;
-        neighbors[3] = particle.CellIndex + ld;
-        neighbors[4] = particle.CellIndex;
-        neighbors[5] = particle.CellIndex + rd;
-        neighbors[6] = particle.CellIndex + ld + dd;
-        neighbors[7] = particle.CellIndex + dd;
-        neighbors[8] = particle.CellIndex + rd + dd;
-      }
-
-      // Iterate over these neighbors
-      for (std::size_t neighbor = 0; neighbor < numNeighbors; neighbor++)
-      {
-        int32_t cellIndex = neighbors[neighbor];
-        Cell &cell = cells[cellIndex];
-
-        for (std::size_t j = 0; j < cell.Particles.size(); j++)
-        {
-          std::size_t otherID = cell.Particles[j];
-          if (particle.ID == otherID)
-            continue;
-          Particle &other = particles[otherID];
-
-          particle.NetForce += ForceFunction(particle, other, system, matrix) * timestep;
-        }
-      }
+      bool left = (cellX == 0), right = (cellX == cellsAcross - 1);
+      bool top = (cellY == 0), bottom = (cellY == cellsAcross - 1);
+      if (left || top) list[0] = s_NoCell;
+      if (top) list[1] = s_NoCell;
+      if (right || top) list[2] = s_NoCell;
+      if (left) list[3] = s_NoCell;
+      if (right) list[5] = s_NoCell;
+      if (left || bottom) list[6] = s_NoCell;
+      if (bottom) list[7] = s_NoCell;
+      if (right || bottom) list[8] = s_NoCell;
     }
-  };
+  }
+
+  return neighbors;
+}
+
+void ColorForce::ApplyForces(System* system, const ColorMatrix& matrix, float timestep)
+{
+  std::vector<Particle>& particles = system->GetParticles();
+  bool periodic = system->GetBoundaryMode() == BoundaryMode::Periodic;
+  if (particles.size() == 0) return;
+
+  // Settled particles only stay settled under the same forces, so they wake up when those change
+  bool resampled = m_Tabulated && m_ForceProfile.Update(system->GetInteractionRadius(), m_RepulsionRadius);
+  if (resampled || m_Tabulated != m_WasTabulated) system->WakeAll();
+  m_WasTabulated = m_Tabulated;
+
+  // Gather everything the kernel needs up front. The neighbors of each cell are found once per step, rather than once per particle.
+  ForceKernelContext context;
+  context.Particles = &particles;
+  context.Cells = &system->GetCells();
+  context.NeighborTable = BuildNeighborTable(system, periodic);
+  context.CellsAcross = system->GetCellsAcross();
+  context.Periodic = periodic;
+  context.SystemSize = system->GetBoundingBoxSize();
+  context.InteractionRadius = system->GetInteractionRadius();
+  context.RepulsionRadius = m_RepulsionRadius;
+  context.Timestep = timestep;
+  context.AttractionScales = matrix.GetAttractionScales();
+  context.NumColors = matrix.GetNumColors();
+  context.SleepingCells = system->GetSleepingCells();
+
+  // The profile was resampled above if it needed to be
+  if (m_Tabulated) context.Profile = &m_ForceProfile;
+
+  // Only measure observables on the steps that they ask for
+  constexpr static std::size_t numWorkers = 16;
+  context.Observer = (m_Observables && m_Observables->NextStep()) ? m_Observables : nullptr;
+  if (context.Observer) context.Observer->Begin(system, context.NumColors, numWorkers);
+
+  // Use the kernel compiled for this configuration, which only observes on measured steps
+  ForceKernel kernel = m_GenericKernel ? GetGenericForceKernel() : GetForceKernel(periodic, m_Tabulated, context.Observer != nullptr);
 
   // If we have less than 100 particles, the overhead isn't needed, and it's hard to distrubute particles anyways
-  if (particles.size() == 0)
-  {
-    return;
-  }
-  else if (particles.size() < 100 || !m_Multithreaded)
+  if (particles.size() < 100 || !m_Multithreaded)
   {
-    jobFunc(0, particles.size() - 1, timestep);
+    kernel(context, 0, 0, particles.size() - 1);
   }
   else
   {
-    // Spawn our job threads
-    constexpr static std::size_t numWorkers = 16;
+    // Hand out our jobs to the pool, which is kept alive between steps. (We only write to our
+    // specified particle[i].netforce and never read it, so there's no need for locks)
     std::size_t particlesPerWorker = particles.size() / numWorkers + 1; // integer division, add 1 (cover all)
 
-    std::thread workers[numWorkers];
-    for (std::size_t i = 0; i < numWorkers; i++)
+    auto workerFunc = [&](std::size_t worker)
     {
-      std::size_t start = i * particlesPerWorker;
+      std::size_t start = worker * particlesPerWorker;
       std::size_t end = start + (particlesPerWorker - 1);
       end = (end >= particles.size()) ? particles.size() - 1 : end; // cap end at last particle.
 
-      workers[i] = std::thread(jobFunc, start, end, timestep);
-    }
-
-    // Wait for our workers
-    for (std::size_t i = 0; i < numWorkers; i++)
-    {
-      workers[i].join();
-    }
+      kernel(context, worker, start, end);
+    };
+    m_ThreadPool.Dispatch(numWorkers, workerFunc);
   }
+
+  if (context.Observer) context.Observer->End(timestep);
 }
 
-}
\ No newline at end of file
+}
@@ -1,13 +1,18 @@
 #pragma once
 
+#include <limits>
 #include <glm/vec2.hpp>
 
 #include "ForceApplicator.h"
 #include "ColorMatrix.h"
+#include "ThreadPool.h"
+#include "ForceKernel.h"
 
 namespace Speck
 {
 
+class Observables;
+
 class ColorForce : public ForceApplicator
 {
 public:
@@ -20,9 +25,39 @@ public:
   void SetMultiThreaded(bool multithreaded = true) { m_Multithreaded = multithreaded; }
   bool IsMultiThreaded() const { return m_Multithreaded; }
 
+  // Looks forces up from a sampled profile instead of evaluating them. The profile's curves can be
+  // replaced to try out other forces, but only the tabulated kernels use them.
+  void SetTabulated(bool tabulated = true) { m_Tabulated = tabulated; }
+  bool IsTabulated() const { return m_Tabulated; }
+
+  // Uses the generic kernel instead of the one compiled for the configuration, to benchmark the difference.
+  void SetGenericKernel(bool generic = true) { m_GenericKernel = generic; }
+  bool UsesGenericKernel() const { return m_GenericKernel; }
+
+  ForceProfile& GetForceProfile() { return m_ForceProfile; }
+  float GetRepulsionRadius() const { return m_RepulsionRadius; }
+
+  // Observables are measured during the neighbor sweep when set and enabled.
+  void SetObservables(Observables* observables) { m_Observables = observables; }
+
+public:
+  constexpr static float s_DefaultRepulsionRadius = 0.3f; // as a fraction of the interaction radius
+  constexpr static std::size_t s_NumNeighbors = 9;
+  constexpr static GridIndex s_NoCell = std::numeric_limits<GridIndex>::max(); // neighbor past a non-periodic edge
+
 private:
-  float m_RepulsionRadius = 0.3f;
+  GridIndex* BuildNeighborTable(System* system, bool periodic);
+
+private:
+  float m_RepulsionRadius = s_DefaultRepulsionRadius;
   bool m_Multithreaded = true;
+  bool m_Tabulated = false;
+  bool m_GenericKernel = false;
+  bool m_WasTabulated = false; // as of the last step
+  ForceProfile m_ForceProfile;
+  ThreadPool m_ThreadPool;
+
+  Observables* m_Observables = nullptr;
 };
   
 }
\ No newline at end of file
@@ -47,4 +47,16 @@ float ColorMatrix::GetAttractionScale(std::size_t primary, std::size_t other) co
   return m_AttractionScales[index];
 }
 
+void ColorMatrix::Interpolate(const ColorMatrix& from, const ColorMatrix& to, float t)
+{
+  assert(from.m_Colors.size() == to.m_Colors.size());
+  m_Colors = to.m_Colors;
+  m_AttractionScales.resize(to.m_AttractionScales.size());
+
+  for (std::size_t i = 0; i < m_AttractionScales.size(); i++)
+  {
+    m_AttractionScales[i] = glm::mix(from.m_AttractionScales[i], to.m_AttractionScales[i], t);
+  }
+}
+
 }
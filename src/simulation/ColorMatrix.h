@@ -18,6 +18,10 @@ public:
 
   void SetAttractionScale(std::size_t primary, std::size_t other, float scale);
   float GetAttractionScale(std::size_t primary, std::size_t other) const;
+  const float* GetAttractionScales() const { return m_AttractionScales.data(); }
+
+  // Blends two matrices of the same size into this one, taking the colors from the second.
+  void Interpolate(const ColorMatrix& from, const ColorMatrix& to, float t);
 
 private:
   std::vector<glm::vec4> m_Colors;
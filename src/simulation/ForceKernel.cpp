@@ -0,0 +1,190 @@
+#include "ForceKernel.h"
+
+#include <utility>
+#include <type_traits>
+
+#include "ColorForce.h"
+#include "Observables.h"
+
+namespace Speck
+{
+
+// A kernel for a particular boundary mode and force evaluation. Observing is compiled in separately,
+// so the steps that measure nothing don't pay for it in the inner loop.
+template <bool Periodic, bool Tabulated, bool Observed>
+static void ColorForceKernel(const ForceKernelContext& context, std::size_t worker, std::size_t start, std::size_t end)
+{
+  std::vector<Particle>& particles = *context.Particles;
+  const std::vector<Cell>& cells = *context.Cells;
+  GridIndex cellsAcross = static_cast<GridIndex>(context.CellsAcross);
+  float systemSize = context.SystemSize;
+  float interactionRadius = context.InteractionRadius;
+  float repulsionRadius = context.RepulsionRadius;
+  ForceTable table = Tabulated ? context.Profile->GetTable() : ForceTable();
+  const std::uint8_t* sleepingCells = context.SleepingCells;
+  Observables* observer = context.Observer;
+  const float* scales = context.AttractionScales;
+  std::size_t numColors = context.NumColors;
+
+  for (std::size_t i = start; i <= end; i++)
+  {
+    Particle &particle = particles[i];
+    if constexpr (Observed) observer->AccumulateParticle(worker, particle);
+
+    // Settled particles feel nothing until their neighborhood wakes up, but on measured steps
+    // their neighbors are still counted, so the observables don't change with sleeping.
+    bool asleep = sleepingCells && sleepingCells[particle.CellIndex];
+    if (asleep && !Observed)
+      continue;
+
+    const GridIndex* neighbors = context.NeighborTable + particle.CellIndex * ColorForce::s_NumNeighbors;
+    const float* particleScales = scales + particle.Color * numColors;
+
+    // Sums the force from every neighbor, with or without the wrapping branches. Everything the
+    // inner loop reads is copied into locals first, so it can stay in registers.
+    auto sweep = [&](auto wrap, auto measureOnly)
+    {
+      constexpr bool Wrap = decltype(wrap)::value;
+      constexpr bool MeasureOnly = decltype(measureOnly)::value;
+
+      const glm::vec2 position = particle.Position;
+      const ParticleIndex id = particle.ID;
+      auto sweepCell = [&](GridIndex cellIndex) -> glm::vec2
+      {
+        glm::vec2 cellForce = glm::vec2(0.0f);
+        if constexpr (!Periodic)
+        {
+          if (cellIndex == ColorForce::s_NoCell) return cellForce;
+        }
+
+        const Cell& cell = cells[cellIndex];
+        for (std::size_t j = 0; j < cell.Particles.size(); j++)
+        {
+          ParticleIndex otherID = cell.Particles[j];
+          if (id == otherID)
+            continue;
+          const Particle &other = particles[otherID];
+
+          // Wrapped here rather than in the force, so the observables can share the distance
+          glm::vec2 delta = other.Position - position;
+          if constexpr (Wrap) delta = MinimumImage(delta, systemSize);
+
+          if constexpr (!MeasureOnly)
+          {
+            if constexpr (Tabulated)
+              cellForce += TabulatedPairForce<false>(delta, systemSize, interactionRadius, table, particleScales[other.Color]);
+            else
+              cellForce += PairForce<false>(delta, systemSize, interactionRadius, repulsionRadius, particleScales[other.Color]);
+          }
+          if constexpr (Observed) observer->AccumulatePair(worker, particle, other, glm::dot(delta, delta));
+        }
+        return cellForce;
+      };
+
+      // The loop over the neighboring cells is unrolled at compile time.
+      glm::vec2 netForce = [&]<std::size_t... Neighbor>(std::index_sequence<Neighbor...>)
+      {
+        return (sweepCell(neighbors[Neighbor]) + ...);
+      }(std::make_index_sequence<ColorForce::s_NumNeighbors>());
+
+      if constexpr (!MeasureOnly) particle.NetForce += netForce * context.Timestep;
+    };
+    auto sweepParticle = [&](auto wrap)
+    {
+      if constexpr (Observed)
+      {
+        if (asleep)
+        {
+          sweep(wrap, std::true_type());
+          return;
+        }
+      }
+      sweep(wrap, std::false_type());
+    };
+
+    // Only particles in a border cell of a periodic system can see across the edge, so everyone
+    // else skips the wrapping. With fewer than four cells across, even the middle cells can.
+    if constexpr (Periodic)
+    {
+      GridIndex cellX = particle.CellIndex % cellsAcross;
+      GridIndex cellY = particle.CellIndex / cellsAcross;
+      bool border = cellsAcross < 4 || cellX == 0 || cellY == 0 || cellX == cellsAcross - 1 || cellY == cellsAcross - 1;
+
+      if (border) sweepParticle(std::true_type());
+      else sweepParticle(std::false_type());
+    }
+    else
+    {
+      sweepParticle(std::false_type());
+    }
+  }
+}
+
+// Reads every setting per pair, without unrolling, skipping the wrap or hoisting anything.
+static void GenericForceKernel(const ForceKernelContext& context, std::size_t worker, std::size_t start, std::size_t end)
+{
+  std::vector<Particle>& particles = *context.Particles;
+  const std::vector<Cell>& cells = *context.Cells;
+
+  for (std::size_t i = start; i <= end; i++)
+  {
+    Particle &particle = particles[i];
+    if (context.Observer) context.Observer->AccumulateParticle(worker, particle);
+
+    bool asleep = context.SleepingCells && context.SleepingCells[particle.CellIndex];
+    if (asleep && !context.Observer)
+      continue;
+
+    for (std::size_t neighbor = 0; neighbor < ColorForce::s_NumNeighbors; neighbor++)
+    {
+      GridIndex cellIndex = context.NeighborTable[particle.CellIndex * ColorForce::s_NumNeighbors + neighbor];
+      if (cellIndex == ColorForce::s_NoCell)
+        continue;
+
+      const Cell& cell = cells[cellIndex];
+      for (std::size_t j = 0; j < cell.Particles.size(); j++)
+      {
+        ParticleIndex otherID = cell.Particles[j];
+        if (particle.ID == otherID)
+          continue;
+        const Particle &other = particles[otherID];
+
+        glm::vec2 delta = other.Position - particle.Position;
+        if (context.Periodic) delta = MinimumImage(delta, context.SystemSize);
+        if (context.Observer) context.Observer->AccumulatePair(worker, particle, other, glm::dot(delta, delta));
+        if (asleep)
+          continue;
+
+        float attractionScale = context.AttractionScales[particle.Color * context.NumColors + other.Color];
+        if (context.Profile)
+          particle.NetForce += TabulatedPairForce<false>(delta, context.SystemSize, context.InteractionRadius, context.Profile->GetTable(), attractionScale) * context.Timestep;
+        else
+          particle.NetForce += PairForce<false>(delta, context.SystemSize, context.InteractionRadius, context.RepulsionRadius, attractionScale) * context.Timestep;
+      }
+    }
+  }
+}
+
+// Indexed by [periodic][tabulated][observed]
+static constexpr ForceKernel s_Kernels[2][2][2] = {
+  {
+    { &ColorForceKernel<false, false, false>, &ColorForceKernel<false, false, true> },
+    { &ColorForceKernel<false, true, false>, &ColorForceKernel<false, true, true> }
+  },
+  {
+    { &ColorForceKernel<true, false, false>, &ColorForceKernel<true, false, true> },
+    { &ColorForceKernel<true, true, false>, &ColorForceKernel<true, true, true> }
+  }
+};
+
+ForceKernel GetForceKernel(bool periodic, bool tabulated, bool observed)
+{
+  return s_Kernels[periodic][tabulated][observed];
+}
+
+ForceKernel GetGenericForceKernel()
+{
+  return &GenericForceKernel;
+}
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Particle.h"
+#include "ForceProfile.h"
+
+namespace Speck
+{
+
+class Observables;
+
+/// Everything a force kernel reads during a step, gathered once before the sweep.
+struct ForceKernelContext
+{
+  std::vector<Particle>* Particles = nullptr;
+  const std::vector<Cell>* Cells = nullptr;
+  const GridIndex* NeighborTable = nullptr; // ColorForce::s_NumNeighbors entries per cell
+  std::size_t CellsAcross = 0;
+  bool Periodic = false; // compiled kernels know this already, only the generic kernel reads it
+
+  float SystemSize = 0.0f;
+  float InteractionRadius = 0.0f;
+  float RepulsionRadius = 0.0f;
+  float Timestep = 0.0f;
+
+  const float* AttractionScales = nullptr; // accessed via index = primary * NumColors + other
+  std::size_t NumColors = 0;
+
+  const ForceProfile* Profile = nullptr; // only used by tabulated kernels
+  const std::uint8_t* SleepingCells = nullptr; // optional, particles in these cells are skipped
+
+  Observables* Observer = nullptr; // only used by observing kernels
+};
+
+// Sums the color force on the particles in [start, end], on behalf of a worker.
+using ForceKernel = void (*)(const ForceKernelContext& context, std::size_t worker, std::size_t start, std::size_t end);
+
+// Picks the kernel compiled for this boundary mode and force evaluation, and whether the step is measured.
+ForceKernel GetForceKernel(bool periodic, bool tabulated, bool observed);
+
+// A single kernel that checks every setting at runtime, for each pair, the way ForceFunction does.
+// It is the baseline the compiled kernels are benchmarked against.
+ForceKernel GetGenericForceKernel();
+
+// The shortest direction between two particles in a periodic system.
+inline glm::vec2 MinimumImage(glm::vec2 delta, float systemSize)
+{
+  if (delta.x > systemSize) delta.x -= 2.0f  * systemSize;
+  if (delta.x < -systemSize) delta.x += 2.0f * systemSize;
+  if (delta.y > systemSize) delta.y -= 2.0f  * systemSize;
+  if (delta.y < -systemSize) delta.y += 2.0f * systemSize;
+  return delta;
+}
+
+// The force that other exerts on a particle, given the direction towards it.
+template <bool Wrap>
+inline glm::vec2 PairForce(glm::vec2 delta, float systemSize, float interactionRadius, float repulsionRadius, float attractionScale)
+{
+  // Account for boundary wrapping.
+  if constexpr (Wrap) delta = MinimumImage(delta, systemSize);
+  
+  float distance = glm::length(delta);
+  
+  // An interesting consequence of non-inverse-square law repulsion 
+  // is that it minimizes potential energy to create pockets instead of uniform particles.
+  // We may want a more physically accurate simulation in the future, that accounts for the
+  // total energy in the system.
+  if (distance <= repulsionRadius * interactionRadius)
+  {
+    float forceStrength = (distance / repulsionRadius - interactionRadius);
+    glm::vec2 dir = delta / distance;
+    return forceStrength * dir;
+  }
+  else if (distance <= interactionRadius)
+  {
+    float forceStrength = interactionRadius - glm::abs((2.0f * distance - interactionRadius - repulsionRadius * interactionRadius) / (1.0f - repulsionRadius));
+    forceStrength *= attractionScale;
+    glm::vec2 dir = delta / distance;
+    
+    return forceStrength * dir;
+  }
+  else
+  {
+    return { 0.0f, 0.0f };
+  }
+}
+
+// The same force as above, looked up from a force profile rather than evaluated.
+template <bool Wrap>
+inline glm::vec2 TabulatedPairForce(glm::vec2 delta, float systemSize, float interactionRadius, const ForceTable& table, float attractionScale)
+{
+  if constexpr (Wrap) delta = MinimumImage(delta, systemSize);
+
+  // Whether a pair is in range is hard to predict, so we select rather than branch.
+  float distanceSq = glm::dot(delta, delta);
+  float inRange = (distanceSq < interactionRadius * interactionRadius) ? 1.0f : 0.0f;
+
+  // The samples are already divided by the distance, so delta doesn't need normalizing.
+  glm::vec2 sample = table.Sample(distanceSq) * inRange;
+  return (sample.x + attractionScale * sample.y) * delta;
+}
+
+}
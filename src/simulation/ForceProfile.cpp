@@ -0,0 +1,77 @@
+#include "ForceProfile.h"
+
+namespace Speck
+{
+
+// The same piecewise-linear force as PairForce, split into its two parts
+static float DefaultRepulsion(float distance, float interactionRadius, float repulsionRadius)
+{
+  if (distance > repulsionRadius * interactionRadius) return 0.0f;
+  return distance / repulsionRadius - interactionRadius;
+}
+
+static float DefaultAttraction(float distance, float interactionRadius, float repulsionRadius)
+{
+  if (distance <= repulsionRadius * interactionRadius || distance > interactionRadius) return 0.0f;
+  return interactionRadius - glm::abs((2.0f * distance - interactionRadius - repulsionRadius * interactionRadius) / (1.0f - repulsionRadius));
+}
+
+ForceProfile::ForceProfile(std::size_t numSamples)
+  : m_NumSamples(numSamples), m_Samples(numSamples + 2, glm::vec2(0.0f)), m_CoreSamples(s_NumCoreSamples + 2, glm::vec2(0.0f))
+{
+  ResetCurves();
+}
+
+void ForceProfile::SetCurves(const Curve& repulsion, const Curve& attraction)
+{
+  m_Repulsion = repulsion;
+  m_Attraction = attraction;
+  m_Dirty = true;
+}
+
+void ForceProfile::ResetCurves()
+{
+  SetCurves(DefaultRepulsion, DefaultAttraction);
+}
+
+bool ForceProfile::Update(float interactionRadius, float repulsionRadius)
+{
+  if (!m_Dirty && interactionRadius == m_InteractionRadius && repulsionRadius == m_RepulsionRadius)
+    return false;
+
+  m_InteractionRadius = interactionRadius;
+  m_RepulsionRadius = repulsionRadius;
+  m_Dirty = false;
+
+  float radiusSq = interactionRadius * interactionRadius;
+  float step = radiusSq / static_cast<float>(m_NumSamples);
+  m_SamplesPerUnit = 1.0f / step;
+
+  // Near zero the strength itself is sampled, since dividing by the distance blows up
+  auto strength = [&](float distance)
+  {
+    return glm::vec2(m_Repulsion(distance, interactionRadius, repulsionRadius), m_Attraction(distance, interactionRadius, repulsionRadius));
+  };
+  m_CoreDistanceSq = static_cast<float>(s_CoreIntervals) * step;
+  float coreDistance = glm::sqrt(m_CoreDistanceSq);
+  m_CoreSamplesPerUnit = static_cast<float>(s_NumCoreSamples) / coreDistance;
+  for (std::size_t i = 0; i <= s_NumCoreSamples; i++)
+    m_CoreSamples[i] = strength(static_cast<float>(i) / m_CoreSamplesPerUnit);
+  m_CoreSamples[s_NumCoreSamples + 1] = m_CoreSamples[s_NumCoreSamples];
+
+  for (std::size_t i = 0; i <= m_NumSamples; i++)
+  {
+    // The core covers the first samples, the first still holds the second's value so it stays finite.
+    float distanceSq = static_cast<float>(i > 0 ? i : 1) * step;
+    float distance = glm::sqrt(distanceSq);
+
+    m_Samples[i] = strength(distance) / distance;
+  }
+
+  // Never weighted, but lets a lookup clamped to the interaction radius still interpolate.
+  m_Samples[m_NumSamples + 1] = glm::vec2(0.0f);
+
+  return true;
+}
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+
+namespace Speck
+{
+
+/// A view of a force profile's samples, small enough for a kernel to keep in registers.
+struct ForceTable
+{
+  const glm::vec2* Samples = nullptr;
+  float SamplesPerUnit = 0.0f; // samples per unit of squared distance
+  float MaxPosition = 0.0f;    // the sample at the interaction radius
+
+  // Close to zero the strength over distance blows up, so the core has its own samples
+  const glm::vec2* CoreSamples = nullptr;
+  float CoreSamplesPerUnit = 0.0f; // samples per unit of distance
+  float CoreDistanceSq = 0.0f;
+
+  // The (repulsion, attraction) strength over distance, linearly interpolated. Distances past
+  // the interaction radius are clamped to it.
+  glm::vec2 Sample(float distanceSq) const
+  {
+    if (distanceSq < CoreDistanceSq) return SampleCore(distanceSq);
+
+    float position = glm::min(distanceSq * SamplesPerUnit, MaxPosition);
+    int index = static_cast<int>(position); // a signed conversion is a single instruction
+    return glm::mix(Samples[index], Samples[index + 1], position - static_cast<float>(index));
+  }
+
+  // Close pairs are rare, so they can afford a square root to interpolate the strength itself.
+  glm::vec2 SampleCore(float distanceSq) const
+  {
+    float distance = glm::sqrt(distanceSq);
+    if (distance == 0.0f) return glm::vec2(0.0f); // no direction to push in
+
+    float position = distance * CoreSamplesPerUnit;
+    int index = static_cast<int>(position);
+    return glm::mix(CoreSamples[index], CoreSamples[index + 1], position - static_cast<float>(index)) / distance;
+  }
+};
+
+/// The color force as a function of distance, sampled ahead of time so the force kernel can
+/// look it up instead of evaluating it. Samples are spaced evenly over the squared distance,
+/// so a lookup doesn't need a square root, and store the strength divided by the distance, so
+/// the force is just the sample times the direction vector. Each sample holds the repulsion
+/// term, and the attraction term which is scaled by the color matrix. Over the first few samples
+/// the strength itself is sampled over the distance instead, so the repulsive core survives.
+class ForceProfile
+{
+public:
+  // The strength of a force at a distance, where positive values attract.
+  using Curve = std::function<float(float distance, float interactionRadius, float repulsionRadius)>;
+
+  ForceProfile(std::size_t numSamples = 2048);
+
+  // Replace the default piecewise-linear curves with our own.
+  void SetCurves(const Curve& repulsion, const Curve& attraction);
+  void ResetCurves();
+
+  // Resamples the curves, but only if something changed since the last update. Returns whether it did.
+  bool Update(float interactionRadius, float repulsionRadius);
+
+  ForceTable GetTable() const
+  {
+    return { m_Samples.data(), m_SamplesPerUnit, static_cast<float>(m_NumSamples), m_CoreSamples.data(), m_CoreSamplesPerUnit, m_CoreDistanceSq };
+  }
+  std::size_t GetNumSamples() const { return m_NumSamples; }
+
+public:
+  constexpr static std::size_t s_CoreIntervals = 8;   // of the main samples, covered by the core
+  constexpr static std::size_t s_NumCoreSamples = 32;
+
+private:
+  std::size_t m_NumSamples;
+  std::vector<glm::vec2> m_Samples; // one extra past the interaction radius, so lookups can always interpolate
+  float m_SamplesPerUnit = 0.0f;
+  std::vector<glm::vec2> m_CoreSamples; // two extra at the edge of the core, in case the square root rounds up
+  float m_CoreSamplesPerUnit = 0.0f;
+  float m_CoreDistanceSq = 0.0f;
+
+  Curve m_Repulsion;
+  Curve m_Attraction;
+
+  // The parameters of the current samples
+  float m_InteractionRadius = 0.0f;
+  float m_RepulsionRadius = 0.0f;
+  bool m_Dirty = true;
+};
+
+}
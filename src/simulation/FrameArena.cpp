@@ -0,0 +1,50 @@
+#include "FrameArena.h"
+
+#include <cstdint>
+
+namespace Speck
+{
+
+FrameArena::FrameArena(std::size_t capacity)
+  : m_Capacity(capacity)
+{
+  if (capacity > 0)
+    m_Block = std::make_unique_for_overwrite<std::byte[]>(capacity);
+}
+
+void* FrameArena::Allocate(std::size_t size, std::size_t alignment)
+{
+  // Align the address, not the offset, since the block is only aligned to max_align_t
+  std::uintptr_t base = reinterpret_cast<std::uintptr_t>(m_Block.get());
+  std::uintptr_t aligned = (base + m_Offset + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+  std::size_t end = static_cast<std::size_t>(aligned - base) + size;
+
+  if (m_Block && end <= m_Capacity)
+  {
+    m_Offset = end;
+    return reinterpret_cast<void*>(aligned);
+  }
+
+  // Out of space, so this step falls back on the heap.
+  std::size_t overflowSize = size + alignment;
+  m_Overflow.push_back(std::make_unique_for_overwrite<std::byte[]>(overflowSize));
+  m_OverflowSize += overflowSize;
+
+  std::uintptr_t overflow = reinterpret_cast<std::uintptr_t>(m_Overflow.back().get());
+  return reinterpret_cast<void*>((overflow + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1));
+}
+
+void FrameArena::Reset()
+{
+  m_Offset = 0;
+  if (m_Overflow.empty()) return;
+
+  // Grow enough to hold the last step with room to spare, so we settle quickly.
+  m_Capacity = (m_Capacity + m_OverflowSize) * 3 / 2;
+  m_Block = std::make_unique_for_overwrite<std::byte[]>(m_Capacity);
+
+  m_Overflow.clear();
+  m_OverflowSize = 0;
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace Speck
+{
+
+/// A linear allocator for scratch memory that only lives for a single step. Memory is
+/// handed out by bumping an offset, and everything is released at once by Reset().
+/// If a step needs more than the arena holds, overflow blocks are used and the arena
+/// grows on the next reset, so once warmed up a step never touches the heap.
+class FrameArena
+{
+public:
+  FrameArena(std::size_t capacity = 0);
+
+  void* Allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+  template <typename T>
+  T* Allocate(std::size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+  void Reset();
+
+  std::size_t GetCapacity() const { return m_Capacity; }
+  std::size_t GetUsed() const { return m_Offset + m_OverflowSize; }
+
+private:
+  std::unique_ptr<std::byte[]> m_Block;
+  std::size_t m_Capacity = 0;
+  std::size_t m_Offset = 0;
+
+  // Blocks allocated once the main block is full, merged into it on reset.
+  std::vector<std::unique_ptr<std::byte[]>> m_Overflow;
+  std::size_t m_OverflowSize = 0;
+};
+
+}
@@ -0,0 +1,258 @@
+#include "Observables.h"
+
+#include <filesystem>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "System.h"
+
+namespace Speck
+{
+
+Observables::Observables(std::size_t historySize, std::size_t numBins)
+  : m_NumBins(numBins), m_History(historySize)
+{
+}
+
+Observables::~Observables()
+{
+  CloseSink();
+}
+
+bool Observables::OpenSink(const std::string& path, SinkFormat format)
+{
+  CloseSink();
+
+  std::ios::openmode mode = std::ios::out | std::ios::trunc;
+  if (format == SinkFormat::Binary) mode |= std::ios::binary;
+
+  m_Sink.open(path, mode);
+  m_PairSink.open(GetPairSinkPath(path), mode);
+  m_SinkFormat = format;
+  if (!m_Sink.is_open() || !m_PairSink.is_open())
+  {
+    CloseSink();
+    return false;
+  }
+
+  if (format == SinkFormat::CSV)
+  {
+    m_Sink << "step,kinetic_energy,mean_neighbors,clusters,largest_cluster\n";
+    m_PairSink << "step,primary,other,mean_neighbors,radius,radial_distribution\n";
+  }
+
+  return true;
+}
+
+void Observables::CloseSink()
+{
+  if (m_Sink.is_open()) m_Sink.close();
+  if (m_PairSink.is_open()) m_PairSink.close();
+}
+
+std::string Observables::GetPairSinkPath(const std::string& path)
+{
+  std::filesystem::path pairPath = path;
+  pairPath.replace_filename(pairPath.stem().string() + "_pairs" + pairPath.extension().string());
+  return pairPath.string();
+}
+
+bool Observables::NextStep()
+{
+  if (!m_Enabled) return false;
+  return (m_Step++ % m_SampleInterval) == 0;
+}
+
+void Observables::Begin(const System* system, std::size_t numColors, std::size_t numWorkers)
+{
+  const std::vector<Particle>& particles = system->GetParticles();
+
+  m_Size = system->GetBoundingBoxSize();
+  m_InteractionRadius = system->GetInteractionRadius();
+  m_InteractionRadiusSq = m_InteractionRadius * m_InteractionRadius;
+  m_BinsPerDistanceSq = static_cast<float>(m_NumBins) / m_InteractionRadiusSq;
+  m_ClusterRadiusSq = (m_ClusterRadius * m_InteractionRadius) * (m_ClusterRadius * m_InteractionRadius);
+  m_NumParticles = particles.size();
+  m_NumColors = numColors;
+
+  // Reset the per-worker accumulators, these only allocate when the configuration changes.
+  std::size_t histogramSize = numColors * numColors * m_NumBins;
+  if (m_Workers.size() != numWorkers) m_Workers.resize(numWorkers);
+  for (WorkerData& worker : m_Workers)
+  {
+    worker.KineticEnergy = 0.0;
+    worker.Histogram.assign(histogramSize, 0);
+  }
+
+  m_ColorCounts.assign(numColors, 0);
+  for (const Particle& particle : particles)
+    m_ColorCounts[particle.Color]++;
+
+  // Every particle starts in its own cluster. Only the first m_NumParticles entries are used.
+  if (m_NumParticles > m_ClusterCapacity)
+  {
+    m_ClusterParents = std::make_unique<std::atomic<std::uint32_t>[]>(m_NumParticles);
+    m_ClusterCapacity = m_NumParticles;
+  }
+  for (std::size_t i = 0; i < m_NumParticles; i++)
+    m_ClusterParents[i].store(static_cast<std::uint32_t>(i), std::memory_order_relaxed);
+}
+
+void Observables::AccumulateParticle(std::size_t worker, const Particle& particle)
+{
+  glm::vec2 delta = particle.Position - particle.LastPosition;
+  m_Workers[worker].KineticEnergy += glm::dot(delta, delta);
+}
+
+void Observables::End(float timestep)
+{
+  ObservableSample sample;
+  sample.Step = m_Step - 1;
+
+  // Verlet deltas are already scaled by the timestep, and every particle has unit mass.
+  double kineticEnergy = 0.0;
+  for (const WorkerData& worker : m_Workers)
+    kineticEnergy += worker.KineticEnergy;
+  sample.KineticEnergy = static_cast<float>(0.5 * kineticEnergy / (static_cast<double>(timestep) * timestep));
+
+  // Merge the histograms into the radial distribution, normalized by an ideal gas of the same density.
+  std::size_t numPairs = m_NumColors * m_NumColors;
+  m_RadialDistribution.assign(numPairs * m_NumBins, 0.0f);
+  m_MeanNeighbors.assign(numPairs, 0.0f);
+
+  float area = 4.0f * m_Size * m_Size;
+  float shell = glm::pi<float>() * m_InteractionRadiusSq / static_cast<float>(m_NumBins); // every ring has the same area
+  std::uint64_t totalNeighbors = 0;
+  for (std::size_t pair = 0; pair < numPairs; pair++)
+  {
+    std::size_t primary = pair / m_NumColors;
+    std::size_t other = pair % m_NumColors;
+
+    std::uint64_t neighbors = 0;
+    for (std::size_t bin = 0; bin < m_NumBins; bin++)
+    {
+      std::uint64_t count = 0;
+      for (const WorkerData& worker : m_Workers)
+        count += worker.Histogram[pair * m_NumBins + bin];
+      neighbors += count;
+
+      float expected = static_cast<float>(m_ColorCounts[primary]) * static_cast<float>(m_ColorCounts[other]) / area * shell;
+      m_RadialDistribution[pair * m_NumBins + bin] = expected > 0.0f ? static_cast<float>(count) / expected : 0.0f;
+    }
+
+    totalNeighbors += neighbors;
+    if (m_ColorCounts[primary] > 0)
+      m_MeanNeighbors[pair] = static_cast<float>(neighbors) / static_cast<float>(m_ColorCounts[primary]);
+  }
+
+  if (m_NumParticles > 0)
+    sample.MeanNeighbors = static_cast<float>(totalNeighbors) / static_cast<float>(m_NumParticles);
+
+  CountClusters(sample);
+
+  m_History.Push(sample);
+  WriteSample(sample);
+}
+
+float Observables::GetRadialDistribution(std::size_t primary, std::size_t other, std::size_t bin) const
+{
+  std::size_t index = (primary * m_NumColors + other) * m_NumBins + bin;
+  return index < m_RadialDistribution.size() ? m_RadialDistribution[index] : 0.0f;
+}
+
+float Observables::GetMeanNeighbors(std::size_t primary, std::size_t other) const
+{
+  std::size_t index = primary * m_NumColors + other;
+  return index < m_MeanNeighbors.size() ? m_MeanNeighbors[index] : 0.0f;
+}
+
+std::uint32_t Observables::FindCluster(std::uint32_t particle)
+{
+  // Path halving. Parents only ever point to lower indices, so a stale read is still a valid ancestor.
+  std::uint32_t parent = m_ClusterParents[particle].load(std::memory_order_relaxed);
+  while (parent != particle)
+  {
+    std::uint32_t grandparent = m_ClusterParents[parent].load(std::memory_order_relaxed);
+    m_ClusterParents[particle].compare_exchange_weak(parent, grandparent, std::memory_order_relaxed);
+    particle = grandparent;
+    parent = m_ClusterParents[particle].load(std::memory_order_relaxed);
+  }
+  return particle;
+}
+
+void Observables::UniteClusters(std::uint32_t a, std::uint32_t b)
+{
+  while (true)
+  {
+    a = FindCluster(a);
+    b = FindCluster(b);
+    if (a == b) return;
+
+    // Always link the higher root beneath the lower one, so there can be no cycles.
+    if (a < b) std::swap(a, b);
+    std::uint32_t expected = a;
+    if (m_ClusterParents[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+      return;
+  }
+}
+
+void Observables::CountClusters(ObservableSample& sample)
+{
+  m_ClusterSizes.assign(m_NumParticles, 0);
+  for (std::size_t i = 0; i < m_NumParticles; i++)
+    m_ClusterSizes[FindCluster(static_cast<std::uint32_t>(i))]++;
+
+  for (std::size_t i = 0; i < m_NumParticles; i++)
+  {
+    std::uint32_t size = m_ClusterSizes[i];
+    if (size >= 2) sample.NumClusters++;
+    if (size > sample.LargestCluster) sample.LargestCluster = size;
+  }
+}
+
+void Observables::WriteSample(const ObservableSample& sample)
+{
+  if (!m_Sink.is_open()) return;
+
+  if (m_SinkFormat == SinkFormat::CSV)
+  {
+    m_Sink << sample.Step << ',' << sample.KineticEnergy << ',' << sample.MeanNeighbors << ','
+           << sample.NumClusters << ',' << sample.LargestCluster << '\n';
+  }
+  else
+  {
+    m_Sink.write(reinterpret_cast<const char*>(&sample), sizeof(ObservableSample));
+  }
+
+  WritePairs(sample);
+}
+
+void Observables::WritePairs(const ObservableSample& sample)
+{
+  std::size_t numPairs = m_NumColors * m_NumColors;
+  if (m_SinkFormat == SinkFormat::CSV)
+  {
+    // Long rather than wide, so the rows don't depend on the number of colors or bins
+    for (std::size_t pair = 0; pair < numPairs; pair++)
+    {
+      for (std::size_t bin = 0; bin < m_NumBins; bin++)
+      {
+        m_PairSink << sample.Step << ',' << pair / m_NumColors << ',' << pair % m_NumColors << ',' << m_MeanNeighbors[pair] << ','
+                   << GetBinRadius(bin) << ',' << m_RadialDistribution[pair * m_NumBins + bin] << '\n';
+      }
+    }
+  }
+  else
+  {
+    ObservablePairHeader header;
+    header.Step = sample.Step;
+    header.NumColors = static_cast<std::uint32_t>(m_NumColors);
+    header.NumBins = static_cast<std::uint32_t>(m_NumBins);
+    header.InteractionRadius = m_InteractionRadius;
+    m_PairSink.write(reinterpret_cast<const char*>(&header), sizeof(ObservablePairHeader));
+    m_PairSink.write(reinterpret_cast<const char*>(m_MeanNeighbors.data()), numPairs * sizeof(float));
+    m_PairSink.write(reinterpret_cast<const char*>(m_RadialDistribution.data()), numPairs * m_NumBins * sizeof(float));
+  }
+}
+
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cmath>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+
+#include "Particle.h"
+#include "RingBuffer.h"
+
+namespace Speck
+{
+
+class System;
+
+/// A single row of scalar metrics recorded for a sampled step.
+struct ObservableSample
+{
+  std::uint64_t Step = 0;
+  float KineticEnergy = 0.0f;
+  float MeanNeighbors = 0.0f; // average number of particles within the interaction radius
+  std::uint32_t NumClusters = 0; // connected groups of at least two particles
+  std::uint32_t LargestCluster = 0;
+};
+
+/// Leads each sample in a binary pair sink. It is followed by the mean neighbors [primary][other]
+/// and then the radial distribution [primary][other][bin], all as floats.
+struct ObservablePairHeader
+{
+  std::uint64_t Step = 0;
+  std::uint32_t NumColors = 0;
+  std::uint32_t NumBins = 0;
+  float InteractionRadius = 0.0f; // bin b covers up to InteractionRadius * sqrt((b + 1) / NumBins)
+  std::uint32_t Padding = 0;
+};
+
+enum class SinkFormat
+{
+  CSV,   // one row per sample, and one row per species pair and bin in the pair sink
+  Binary // raw ObservableSample structs back to back, and ObservablePairHeader records in the pair sink
+};
+
+/// Observables measure the state of the system while the color force sweeps over
+/// neighboring particles, so no extra pass over the grid is needed. The results of
+/// each sampled step are pushed into a history for the UI, and optionally to a file.
+class Observables
+{
+public:
+  constexpr static std::size_t s_DefaultSampleInterval = 10;
+
+  Observables(std::size_t historySize = 512, std::size_t numBins = 32);
+  ~Observables();
+
+  void SetEnabled(bool enabled = true) { m_Enabled = enabled; }
+  bool IsEnabled() const { return m_Enabled; }
+
+  // Only every nth step is measured, with its own kernels, so the other steps cost nothing extra.
+  // A measured step costs about 30% more in the force pass, so by default only every 10th step
+  // is, which keeps the average cost around 3%.
+  void SetSampleInterval(std::size_t interval) { m_SampleInterval = interval > 0 ? interval : 1; }
+  std::size_t GetSampleInterval() const { return m_SampleInterval; }
+
+  // Particles closer than this fraction of the interaction radius are in the same cluster.
+  void SetClusterRadius(float fraction) { m_ClusterRadius = fraction; }
+  float GetClusterRadius() const { return m_ClusterRadius; }
+
+  // Streams every sample to a file, and the per species results next to it, see GetPairSinkPath.
+  bool OpenSink(const std::string& path, SinkFormat format = SinkFormat::CSV);
+  void CloseSink();
+  bool HasSink() const { return m_Sink.is_open(); }
+  static std::string GetPairSinkPath(const std::string& path); // "name_pairs.ext" next to "name.ext"
+
+  // Advances the step counter, and returns whether this step should be measured.
+  bool NextStep();
+
+  // Called by the force pass. Each worker only touches its own accumulators, apart from
+  // the cluster forest, which is lock-free.
+  void Begin(const System* system, std::size_t numColors, std::size_t numWorkers);
+  void AccumulateParticle(std::size_t worker, const Particle& particle);
+  void AccumulatePair(std::size_t worker, const Particle& particle, const Particle& other, float distanceSq); // inline, below
+  void End(float timestep);
+
+  const RingBuffer<ObservableSample>& GetHistory() const { return m_History; }
+
+  // Per species results of the last sampled step. Bins are spaced evenly over the squared distance,
+  // so every bin covers a ring of the same area.
+  std::size_t GetNumColors() const { return m_NumColors; }
+  std::size_t GetNumBins() const { return m_NumBins; }
+  float GetBinRadius(std::size_t bin) const { return m_InteractionRadius * std::sqrt((static_cast<float>(bin) + 0.5f) / static_cast<float>(m_NumBins)); }
+  float GetRadialDistribution(std::size_t primary, std::size_t other, std::size_t bin) const;
+  float GetMeanNeighbors(std::size_t primary, std::size_t other) const;
+
+private:
+  std::uint32_t FindCluster(std::uint32_t particle);
+  void UniteClusters(std::uint32_t a, std::uint32_t b);
+  void CountClusters(ObservableSample& sample);
+  void WriteSample(const ObservableSample& sample);
+  void WritePairs(const ObservableSample& sample);
+
+private:
+  // Padded so neighboring workers don't share cache lines.
+  struct alignas(64) WorkerData
+  {
+    double KineticEnergy = 0.0;
+    std::vector<std::uint32_t> Histogram; // [primary][other][bin]
+  };
+
+  bool m_Enabled = false;
+  std::size_t m_SampleInterval = s_DefaultSampleInterval;
+  std::uint64_t m_Step = 0;
+  float m_ClusterRadius = 0.3f;
+
+  // Cached from the system at the start of a sampled step
+  float m_Size = 0.0f;
+  float m_InteractionRadius = 0.0f;
+  float m_InteractionRadiusSq = 0.0f;
+  float m_BinsPerDistanceSq = 0.0f;
+  float m_ClusterRadiusSq = 0.0f;
+  std::size_t m_NumParticles = 0;
+  std::size_t m_NumColors = 0;
+  std::size_t m_NumBins = 0;
+  std::vector<std::uint32_t> m_ColorCounts;
+
+  std::vector<WorkerData> m_Workers;
+  // Grow-only, open boundaries change the particle count nearly every step
+  std::unique_ptr<std::atomic<std::uint32_t>[]> m_ClusterParents;
+  std::size_t m_ClusterCapacity = 0;
+  std::vector<std::uint32_t> m_ClusterSizes;
+
+  // Results
+  std::vector<float> m_RadialDistribution; // [primary][other][bin]
+  std::vector<float> m_MeanNeighbors; // [primary][other]
+  RingBuffer<ObservableSample> m_History;
+
+  std::ofstream m_Sink;
+  std::ofstream m_PairSink;
+  SinkFormat m_SinkFormat = SinkFormat::CSV;
+};
+
+// Called for every pair the color force visits, so it is kept inline.
+inline void Observables::AccumulatePair(std::size_t worker, const Particle& particle, const Particle& other, float distanceSq)
+{
+  // The distance comes from the color force, already wrapped, and binning it squared avoids a square root.
+  if (distanceSq >= m_InteractionRadiusSq) return;
+
+  std::size_t bin = static_cast<std::size_t>(distanceSq * m_BinsPerDistanceSq);
+  if (bin >= m_NumBins) bin = m_NumBins - 1;
+  m_Workers[worker].Histogram[(particle.Color * m_NumColors + other.Color) * m_NumBins + bin]++;
+
+  // Each pair is visited from both sides, so only one of them has to join the clusters.
+  if (distanceSq < m_ClusterRadiusSq && particle.ID < other.ID)
+    UniteClusters(particle.ID, other.ID);
+}
+
+}
@@ -1,26 +1,42 @@
 #pragma once
 
+#include <span>
+#include <limits>
+#include <cstdint>
 #include <glm/glm.hpp>
 
 namespace Speck
 {
 
+// Particles and cells are indexed with 32 bits, and colors with 16. Compared to std::size_t,
+// this halves the indices the partition writes and the force kernels read every step.
+using ParticleIndex = std::uint32_t;
+using GridIndex = std::uint32_t;
+using ColorIndex = std::uint16_t;
+
+constexpr std::size_t s_MaxParticles = std::numeric_limits<ParticleIndex>::max();
+constexpr std::size_t s_MaxCells = std::numeric_limits<GridIndex>::max(); // the largest index marks a missing neighbor
+constexpr std::size_t s_MaxCellsAcross = 65535; // the widest square grid with fewer than s_MaxCells cells
+static_assert(s_MaxCellsAcross * s_MaxCellsAcross < s_MaxCells && (s_MaxCellsAcross + 1) * (s_MaxCellsAcross + 1) >= s_MaxCells);
+constexpr std::size_t s_MaxColors = std::size_t(std::numeric_limits<ColorIndex>::max()) + 1;
+
 struct Particle
 {
   glm::vec2 Position = glm::vec2(0.0f);
   glm::vec2 LastPosition = glm::vec2(0.0f);
   glm::vec2 NetForce = glm::vec2(0.0f); // Calculated relative to the timestep.
   
-  std::size_t Color = 0;
-  
-  std::size_t ID = 0; // Particles also cache their index
-  std::size_t CellIndex = 0; // Particles cache their cells
+  ParticleIndex ID = 0; // Particles also cache their index
+  GridIndex CellIndex = 0; // Particles cache their cells
+
+  ColorIndex Color = 0;
 };
 
 /// A cell stores a list of indices of particle to allow for reduction of unneeded physics calculations.
+/// The indices live in the system's frame arena, so they are only valid until the next partition.
 struct Cell
 {
-  std::vector<std::size_t> Particles;
+  std::span<ParticleIndex> Particles;
 };
 
 }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cassert>
+
+namespace Speck
+{
+
+/// A fixed capacity buffer that overwrites its oldest entry once it is full. Entries
+/// are indexed from oldest (0) to newest (Size() - 1).
+template <typename T>
+class RingBuffer
+{
+public:
+  RingBuffer(std::size_t capacity = 0)
+    : m_Data(capacity) {}
+
+  void Push(const T& value)
+  {
+    if (m_Data.empty()) return;
+
+    m_Data[m_Head] = value;
+    m_Head = (m_Head + 1) % m_Data.size();
+    if (m_Size < m_Data.size()) m_Size++;
+  }
+
+  void Clear() { m_Head = 0; m_Size = 0; }
+
+  std::size_t Size() const { return m_Size; }
+  std::size_t Capacity() const { return m_Data.size(); }
+  bool Empty() const { return m_Size == 0; }
+
+  const T& operator[](std::size_t index) const
+  {
+    assert(index < m_Size);
+    std::size_t oldest = (m_Head + m_Data.size() - m_Size) % m_Data.size();
+    return m_Data[(oldest + index) % m_Data.size()];
+  }
+
+  const T& Back() const { return (*this)[m_Size - 1]; }
+
+private:
+  std::vector<T> m_Data;
+  std::size_t m_Head = 0; // index of the next write
+  std::size_t m_Size = 0;
+};
+
+}
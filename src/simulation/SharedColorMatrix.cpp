@@ -0,0 +1,42 @@
+#include "SharedColorMatrix.h"
+
+namespace Speck
+{
+
+SharedColorMatrix::SharedColorMatrix(const ColorMatrix& matrix)
+  : m_Buffers{matrix, matrix}, m_Staging(matrix), m_MorphStart(matrix)
+{
+}
+
+void SharedColorMatrix::Morph(std::size_t steps)
+{
+  m_MorphStart = GetActive();
+  m_MorphStep = 0;
+  m_MorphSteps = steps;
+}
+
+void SharedColorMatrix::Publish()
+{
+  if (!IsMorphing() && !m_StagingDirty)
+    return;
+
+  // Write into the buffer nobody is reading, then swap it in.
+  std::size_t back = 1 - m_Active.load(std::memory_order_relaxed);
+  if (IsMorphing())
+  {
+    m_MorphStep++;
+    float t = static_cast<float>(m_MorphStep) / static_cast<float>(m_MorphSteps);
+    m_Buffers[back].Interpolate(m_MorphStart, m_Staging, t);
+  }
+  else
+  {
+    m_Buffers[back] = m_Staging; // same size, so this doesn't allocate
+  }
+
+  // Once a morph is over, the last step already published the staged matrix.
+  m_StagingDirty = false;
+  m_Active.store(back, std::memory_order_release);
+  m_Version.fetch_add(1, std::memory_order_release);
+}
+
+}
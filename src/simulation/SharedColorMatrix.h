@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "ColorMatrix.h"
+
+namespace Speck
+{
+
+/// Keeps the color matrix the forces read apart from the one being edited. Edits go to a staging
+/// copy, and Publish() swaps them in between steps, so the force workers always read a consistent
+/// matrix that never changes under them. It can also morph from the current matrix to the staged
+/// one over a number of steps, which only blends the attraction scales once per step.
+class SharedColorMatrix
+{
+public:
+  SharedColorMatrix(const ColorMatrix& matrix = ColorMatrix());
+
+  // The matrix to edit. Changes reach the forces on the next Publish().
+  ColorMatrix& Edit() { m_StagingDirty = true; return m_Staging; }
+  const ColorMatrix& GetStaging() const { return m_Staging; }
+
+  // The matrix the forces read, and how many times it has been published.
+  const ColorMatrix& GetActive() const { return m_Buffers[m_Active.load(std::memory_order_acquire)]; }
+  std::uint64_t GetVersion() const { return m_Version.load(std::memory_order_acquire); }
+
+  // Blends from the active matrix to the staged one over a number of steps. Edits made while
+  // morphing change where we are heading.
+  void Morph(std::size_t steps);
+  bool IsMorphing() const { return m_MorphStep < m_MorphSteps; }
+  float GetMorphProgress() const { return IsMorphing() ? static_cast<float>(m_MorphStep) / static_cast<float>(m_MorphSteps) : 1.0f; }
+
+  // Called at step boundaries, publishes any staged edits or the next step of a morph.
+  void Publish();
+
+private:
+  ColorMatrix m_Buffers[2];
+  std::atomic<std::size_t> m_Active = 0;
+  std::atomic<std::uint64_t> m_Version = 0;
+
+  ColorMatrix m_Staging;
+  bool m_StagingDirty = false;
+
+  // Morphing
+  ColorMatrix m_MorphStart;
+  std::size_t m_MorphStep = 0;
+  std::size_t m_MorphSteps = 0;
+};
+
+}
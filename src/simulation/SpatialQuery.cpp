@@ -0,0 +1,179 @@
+#include "SpatialQuery.h"
+
+#include <algorithm>
+
+#include "System.h"
+
+namespace Speck
+{
+
+SpatialQuery::SpatialQuery(const System* system)
+  : m_System(system)
+{
+}
+
+void SpatialQuery::Radius(const glm::vec2& center, float radius, std::vector<ParticleIndex>& results, int color) const
+{
+  const std::vector<Particle>& particles = m_System->GetParticles();
+  const std::vector<Cell>& cells = m_System->GetCells();
+  std::size_t cellsAcross = m_System->GetCellsAcross();
+
+  // Cell rows go from top to bottom, so the top left corner is the first cell.
+  glm::ivec2 first = GetCell({center.x - radius, center.y + radius});
+  glm::ivec2 last = GetCell({center.x + radius, center.y - radius});
+  float radiusSq = radius * radius;
+
+  for (int y = first.y; y <= last.y; y++)
+  {
+    for (int x = first.x; x <= last.x; x++)
+    {
+      const Cell& cell = cells[GetCellIndex(x, y, cellsAcross)];
+      for (ParticleIndex index : cell.Particles)
+      {
+        const Particle& particle = particles[index];
+        if (color != s_AnyColor && static_cast<int>(particle.Color) != color)
+          continue;
+
+        glm::vec2 delta = particle.Position - center;
+        if (glm::dot(delta, delta) <= radiusSq)
+          results.push_back(index);
+      }
+    }
+  }
+}
+
+void SpatialQuery::Rect(const glm::vec2& min, const glm::vec2& max, std::vector<ParticleIndex>& results, int color) const
+{
+  const std::vector<Particle>& particles = m_System->GetParticles();
+  const std::vector<Cell>& cells = m_System->GetCells();
+  std::size_t cellsAcross = m_System->GetCellsAcross();
+
+  glm::ivec2 first = GetCell({min.x, max.y});
+  glm::ivec2 last = GetCell({max.x, min.y});
+
+  for (int y = first.y; y <= last.y; y++)
+  {
+    for (int x = first.x; x <= last.x; x++)
+    {
+      const Cell& cell = cells[GetCellIndex(x, y, cellsAcross)];
+      for (ParticleIndex index : cell.Particles)
+      {
+        const Particle& particle = particles[index];
+        if (color != s_AnyColor && static_cast<int>(particle.Color) != color)
+          continue;
+
+        const glm::vec2& position = particle.Position;
+        if (position.x >= min.x && position.x <= max.x && position.y >= min.y && position.y <= max.y)
+          results.push_back(index);
+      }
+    }
+  }
+}
+
+void SpatialQuery::Nearest(const glm::vec2& center, std::size_t k, std::vector<ParticleIndex>& results) const
+{
+  results.clear();
+
+  const std::vector<Particle>& particles = m_System->GetParticles();
+  const std::vector<Cell>& cells = m_System->GetCells();
+  std::size_t cellsAcross = m_System->GetCellsAcross();
+  int maxRing = static_cast<int>(cellsAcross); // at most s_MaxCellsAcross, so the offsets fit in an int
+  float cellSize = m_System->GetCellSize();
+  if (k == 0 || particles.empty()) return;
+
+  // Max heap of the closest particles so far, so the farthest one is at the front.
+  std::vector<std::pair<float, ParticleIndex>> closest;
+  closest.reserve(k);
+
+  // Search outwards in square rings of cells around the center.
+  glm::ivec2 origin = GetCell(center);
+  for (int ring = 0; ring < maxRing; ring++)
+  {
+    for (int dy = -ring; dy <= ring; dy++)
+    {
+      // Only the top and bottom rows of the ring are full, otherwise we skip to the other side
+      int step = (ring == 0 || dy == -ring || dy == ring) ? 1 : 2 * ring;
+      for (int dx = -ring; dx <= ring; dx += step)
+      {
+        int x = origin.x + dx;
+        int y = origin.y + dy;
+        if (x < 0 || y < 0 || x >= maxRing || y >= maxRing) continue;
+
+        const Cell& cell = cells[GetCellIndex(x, y, cellsAcross)];
+        for (ParticleIndex index : cell.Particles)
+        {
+          glm::vec2 delta = particles[index].Position - center;
+          float distanceSq = glm::dot(delta, delta);
+
+          if (closest.size() < k)
+          {
+            closest.push_back({distanceSq, index});
+            std::push_heap(closest.begin(), closest.end());
+          }
+          else if (distanceSq < closest.front().first)
+          {
+            std::pop_heap(closest.begin(), closest.end());
+            closest.back() = {distanceSq, index};
+            std::push_heap(closest.begin(), closest.end());
+          }
+        }
+      }
+    }
+
+    // Every cell in the next ring is at least this far away, so nothing there can be closer.
+    float nextRingDistance = static_cast<float>(ring) * cellSize;
+    if (closest.size() == k && nextRingDistance * nextRingDistance >= closest.front().first)
+      break;
+  }
+
+  std::sort_heap(closest.begin(), closest.end());
+  results.reserve(closest.size());
+  for (const std::pair<float, ParticleIndex>& entry : closest)
+    results.push_back(entry.second);
+}
+
+ParticleIndex SpatialQuery::Nearest(const glm::vec2& center, float maxRadius) const
+{
+  const std::vector<Particle>& particles = m_System->GetParticles();
+  const std::vector<Cell>& cells = m_System->GetCells();
+  std::size_t cellsAcross = m_System->GetCellsAcross();
+
+  glm::ivec2 first = GetCell({center.x - maxRadius, center.y + maxRadius});
+  glm::ivec2 last = GetCell({center.x + maxRadius, center.y - maxRadius});
+
+  ParticleIndex nearest = s_NoParticle;
+  float nearestDistanceSq = maxRadius * maxRadius;
+  for (int y = first.y; y <= last.y; y++)
+  {
+    for (int x = first.x; x <= last.x; x++)
+    {
+      const Cell& cell = cells[GetCellIndex(x, y, cellsAcross)];
+      for (ParticleIndex index : cell.Particles)
+      {
+        glm::vec2 delta = particles[index].Position - center;
+        float distanceSq = glm::dot(delta, delta);
+        if (distanceSq <= nearestDistanceSq)
+        {
+          nearest = index;
+          nearestDistanceSq = distanceSq;
+        }
+      }
+    }
+  }
+
+  return nearest;
+}
+
+glm::ivec2 SpatialQuery::GetCell(const glm::vec2& position) const
+{
+  float size = m_System->GetBoundingBoxSize();
+  float cellSize = m_System->GetCellSize();
+  int cellsAcross = static_cast<int>(m_System->GetCellsAcross());
+
+  // Same mapping as the partition, clamped so queries outside of the system still work.
+  int x = static_cast<int>(glm::floor((position.x + size) / cellSize));
+  int y = static_cast<int>(glm::floor((size - position.y) / cellSize));
+  return { glm::clamp(x, 0, cellsAcross - 1), glm::clamp(y, 0, cellsAcross - 1) };
+}
+
+}
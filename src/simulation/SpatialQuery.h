@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <glm/glm.hpp>
+
+#include "Particle.h"
+
+namespace Speck
+{
+
+class System;
+
+/// Finds particles using the system's cell grid, so only the cells overlapping a query
+/// are visited. Queries only read the system, so they can run alongside rendering, and
+/// they see the particles as of the last partition. Positions aren't wrapped across
+/// the edges of the simulation.
+class SpatialQuery
+{
+public:
+  constexpr static ParticleIndex s_NoParticle = std::numeric_limits<ParticleIndex>::max();
+  constexpr static int s_AnyColor = -1;
+
+  SpatialQuery(const System* system);
+
+  // Appends the index of every particle within the radius of a point.
+  void Radius(const glm::vec2& center, float radius, std::vector<ParticleIndex>& results, int color = s_AnyColor) const;
+
+  // Appends the index of every particle inside of an axis aligned box.
+  void Rect(const glm::vec2& min, const glm::vec2& max, std::vector<ParticleIndex>& results, int color = s_AnyColor) const;
+
+  // Replaces the results with the k closest particles to a point, sorted from nearest to farthest.
+  void Nearest(const glm::vec2& center, std::size_t k, std::vector<ParticleIndex>& results) const;
+
+  // Returns the closest particle within the radius, or s_NoParticle.
+  ParticleIndex Nearest(const glm::vec2& center, float maxRadius) const;
+
+private:
+  glm::ivec2 GetCell(const glm::vec2& position) const;
+
+  // Cells are found with signed offsets, but indexed unsigned so the widest grids can't overflow.
+  static std::size_t GetCellIndex(int x, int y, std::size_t cellsAcross) { return static_cast<std::size_t>(y) * cellsAcross + static_cast<std::size_t>(x); }
+
+private:
+  const System* m_System;
+};
+
+}
@@ -1,5 +1,6 @@
 #include "System.h"
 
+#include <algorithm>
 #include <glm/gtc/random.hpp>
 #include <SDL.h>
 
@@ -15,11 +16,16 @@ System::System(std::size_t numParticles, std::size_t numColors, float size)
 
 void System::AllocateParticles(std::size_t numParticles, std::size_t numColors)
 {
+  // Particles and colors have to fit in their compact indices
+  numParticles = std::min(numParticles, s_MaxParticles);
+  numColors = std::clamp<std::size_t>(numColors, 1, s_MaxColors);
+
   // If we are removing particles
   std::size_t currentParticles = m_Particles.size();
   if (currentParticles >= numParticles)
   {
     m_Particles.resize(numParticles);
+    PartitionsParticles();
     return;
   }
 
@@ -30,7 +36,7 @@ void System::AllocateParticles(std::size_t numParticles, std::size_t numColors)
   for (std::size_t i = currentParticles; i < numParticles; i++)
   {
     Particle p;
-    p.ID = i;
+    p.ID = static_cast<ParticleIndex>(i);
 
     // Uniform Random Distribution
     float x = glm::linearRand(-m_Size, m_Size);
@@ -40,29 +46,43 @@ void System::AllocateParticles(std::size_t numParticles, std::size_t numColors)
 
     p.NetForce = {0.0f, 0.0f};
 
-    p.Color = i % numColors;
+    p.Color = static_cast<ColorIndex>(i % numColors);
 
     m_Particles.push_back(p);
   }
+
+  // Keep the cells in sync so they can be queried right away.
+  PartitionsParticles();
 }
 
 void System::AllocateCells()
 {
   // Cells (as close to interaction radius as possible, without being less)
-  m_CellsAcross = static_cast<std::size_t>(2.0f * m_Size / m_InteractionRadius); // truncate, so our cells are slightly bigger than needed
+  // Clamped before converting, so tiny radii can't overflow the cell indices and huge ones still leave one cell
+  float cellsAcross = std::clamp(2.0f * m_Size / m_InteractionRadius, 1.0f, static_cast<float>(s_MaxCellsAcross));
+  m_CellsAcross = static_cast<std::size_t>(cellsAcross); // truncate, so our cells are slightly bigger than needed
   m_CellSize = (2.0f * m_Size) / static_cast<float>(m_CellsAcross);
   m_Cells.resize(m_CellsAcross * m_CellsAcross);
+
+  // Everyone wakes up on a new grid
+  m_CellAsleep.assign(m_Cells.size(), 0);
+  m_LastCellCounts.assign(m_Cells.size(), 0);
+  m_NumSleepingCells = 0;
+
+  PartitionsParticles();
 }
 
 void System::PartitionsParticles()
 {
-  // Clear all cells
-  for (std::size_t i = 0; i < m_Cells.size(); i++)
-  {
-    m_Cells[i].Particles.clear();
-  }
-  
-  // Emplace all particles into cells
+  // Everything from the last step is released here, including the cell lists.
+  m_FrameArena.Reset();
+
+  // Counting sort, so the cells share one contiguous list instead of growing their own.
+  std::size_t numCells = m_Cells.size();
+  ParticleIndex* cellOffsets = m_FrameArena.Allocate<ParticleIndex>(numCells + 1);
+  std::fill(cellOffsets, cellOffsets + numCells + 1, 0);
+
+  // Find the cell of each particle, and count the particles in each cell
   for (std::size_t i = 0; i < m_Particles.size(); i++)
   {
     Particle& particle = m_Particles[i];
@@ -72,11 +92,113 @@ void System::PartitionsParticles()
     // Due to rounding, we have to ensure that in rare cases, we don't index out of bound
     if (cellX == m_CellsAcross) cellX--;
     if (cellY == m_CellsAcross) cellY--;
-    std::size_t cell = cellY * m_CellsAcross + cellX;
+    GridIndex cell = static_cast<GridIndex>(cellY * m_CellsAcross + cellX);
     
-    m_Cells[cell].Particles.push_back(i);
+    cellOffsets[cell + 1]++;
     particle.CellIndex = cell; // particles cache their cell's index as well.
   }
+
+  // Each cell starts where the previous one ends
+  for (std::size_t cell = 0; cell < numCells; cell++)
+    cellOffsets[cell + 1] += cellOffsets[cell];
+
+  ParticleIndex* cellParticles = m_FrameArena.Allocate<ParticleIndex>(m_Particles.size());
+  for (std::size_t cell = 0; cell < numCells; cell++)
+    m_Cells[cell].Particles = std::span<ParticleIndex>(cellParticles + cellOffsets[cell], 0);
+
+  // Emplace all particles into cells
+  ParticleIndex numParticles = static_cast<ParticleIndex>(m_Particles.size());
+  for (ParticleIndex i = 0; i < numParticles; i++)
+  {
+    Cell& cell = m_Cells[m_Particles[i].CellIndex];
+    std::size_t count = cell.Particles.size();
+    cell.Particles = std::span<ParticleIndex>(cell.Particles.data(), count + 1);
+    cell.Particles[count] = i;
+  }
+
+  if (m_Sleeping) UpdateSleepingCells();
+}
+
+void System::SetSleeping(bool sleeping)
+{
+  m_Sleeping = sleeping;
+
+  // Start from everyone awake, so nothing sleeps on stale information
+  WakeAll();
+}
+
+void System::WakeAll()
+{
+  // Every cell has to see its particles again before it can fall back asleep
+  std::fill(m_CellAsleep.begin(), m_CellAsleep.end(), 0);
+  std::fill(m_LastCellCounts.begin(), m_LastCellCounts.end(), 0);
+  m_NumSleepingCells = 0;
+}
+
+void System::UpdateSleepingCells()
+{
+  std::size_t numCells = m_Cells.size();
+  GridIndex cellsAcross = static_cast<GridIndex>(m_CellsAcross);
+  bool periodic = m_BoundaryMode == BoundaryMode::Periodic;
+
+  // A cell is quiet if all of its particles have settled, and nobody came or went since the last step.
+  std::uint8_t* quiet = m_FrameArena.Allocate<std::uint8_t>(numCells);
+  float displacementSq = m_SleepDisplacement * m_SleepDisplacement;
+  float forceSq = m_SleepForce * m_SleepForce;
+  for (std::size_t cell = 0; cell < numCells; cell++)
+  {
+    ParticleIndex count = static_cast<ParticleIndex>(m_Cells[cell].Particles.size());
+    quiet[cell] = (count == m_LastCellCounts[cell]);
+    m_LastCellCounts[cell] = count;
+
+    for (ParticleIndex index : m_Cells[cell].Particles)
+    {
+      if (!quiet[cell]) break;
+
+      // The forces are still the ones from the step we just took
+      const Particle& particle = m_Particles[index];
+      glm::vec2 displacement = particle.Position - particle.LastPosition;
+      quiet[cell] = glm::dot(displacement, displacement) < displacementSq && glm::dot(particle.NetForce, particle.NetForce) < forceSq;
+    }
+  }
+
+  // A cell only sleeps if its whole neighborhood is quiet. Cells past a non-periodic edge don't exist, so they count as quiet.
+  m_NumSleepingCells = 0;
+  for (GridIndex cellY = 0; cellY < cellsAcross; cellY++)
+  {
+    // The neighboring rows, wrapping around the edges. Everything stays unsigned, like the neighbor table.
+    std::size_t rows[3] = {
+      static_cast<std::size_t>((cellY != 0) ? cellY - 1 : cellsAcross - 1) * cellsAcross,
+      static_cast<std::size_t>(cellY) * cellsAcross,
+      static_cast<std::size_t>((cellY != cellsAcross - 1) ? cellY + 1 : 0) * cellsAcross
+    };
+    bool hasRow[3] = { periodic || cellY != 0, true, periodic || cellY != cellsAcross - 1 };
+
+    for (GridIndex cellX = 0; cellX < cellsAcross; cellX++)
+    {
+      GridIndex columns[3] = { (cellX != 0) ? cellX - 1 : cellsAcross - 1, cellX, (cellX != cellsAcross - 1) ? cellX + 1 : 0 };
+      bool hasColumn[3] = { periodic || cellX != 0, true, periodic || cellX != cellsAcross - 1 };
+
+      bool asleep = true;
+      for (int row = 0; row < 3 && asleep; row++)
+      {
+        for (int column = 0; column < 3 && asleep; column++)
+        {
+          if (hasRow[row] && hasColumn[column])
+            asleep = quiet[rows[row] + columns[column]];
+        }
+      }
+
+      std::size_t cell = rows[1] + cellX;
+      m_CellAsleep[cell] = asleep;
+      if (!asleep) continue;
+
+      // Sleeping particles are held still, otherwise they would drift off without the forces that balanced them.
+      m_NumSleepingCells++;
+      for (ParticleIndex index : m_Cells[cell].Particles)
+        m_Particles[index].LastPosition = m_Particles[index].Position;
+    }
+  }
 }
 
 void System::UpdatePositions(float timestep)
@@ -170,6 +292,35 @@ void System::ClampPositions(float dampening)
   }
 }
 
+void System::RemoveEscapedParticles()
+{
+  // Swap the escaped particles with the last one, since order doesn't matter
+  std::size_t i = 0;
+  while (i < m_Particles.size())
+  {
+    const glm::vec2& position = m_Particles[i].Position;
+    if (position.x >= -m_Size && position.x <= m_Size && position.y >= -m_Size && position.y <= m_Size)
+    {
+      i++;
+      continue;
+    }
+
+    m_Particles[i] = m_Particles.back();
+    m_Particles[i].ID = static_cast<ParticleIndex>(i);
+    m_Particles.pop_back();
+  }
+}
+
+void System::ApplyBoundary()
+{
+  switch (m_BoundaryMode)
+  {
+    case BoundaryMode::Periodic: WrapPositions(); break;
+    case BoundaryMode::Reflective: ClampPositions(); break;
+    case BoundaryMode::Open: RemoveEscapedParticles(); break;
+  }
+}
+
 void System::ZeroForces()
 {
   for (std::size_t i = 0; i < m_Particles.size(); ++i)
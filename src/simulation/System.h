@@ -1,24 +1,38 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <glm/glm.hpp>
 
 #include "Particle.h"
 #include "ColorMatrix.h"
+#include "FrameArena.h"
 
 namespace Speck
 {
 
+/// How particles interact with the edges of the system.
+enum class BoundaryMode
+{
+  Periodic,   // particles wrap around, and interact across the edges
+  Reflective, // particles bounce off of the edges
+  Open        // particles that leave the system are removed
+};
+
 /// A system keeps tracks of all of the particles in the scene.
 class System
 {
   friend class ForceApplicator;
 public:
+  constexpr static float s_DefaultInteractionRadius = 40.0f;
+
   System(std::size_t numParticles = 1000, std::size_t numColors = 1, float size = 100.0f);
 
   void UpdatePositions(float timestep);
   void WrapPositions();                        // wrap particles around the edge
   void ClampPositions(float dampening = 0.7f); // bounce particles off edge (w/ speed *= dampening)
+  void RemoveEscapedParticles();               // remove particles that left the edge
+  void ApplyBoundary();                        // one of the above, depending on the boundary mode
 
   void ZeroForces(); // reset all forces acting on particles.
 
@@ -30,30 +44,61 @@ public:
   void SetBoundingBoxSize(float size) 
   { 
     m_Size = size; 
-    WrapPositions(); 
+    ApplyBoundary(); 
     AllocateCells();
   }
 
+  BoundaryMode GetBoundaryMode() const { return m_BoundaryMode; }
+  void SetBoundaryMode(BoundaryMode mode) { m_BoundaryMode = mode; WakeAll(); ApplyBoundary(); PartitionsParticles(); }
+
   // Particle Partitions
   void AllocateParticles(std::size_t numParticles, std::size_t numColors);
   void AllocateCells();
-  void PartitionsParticles();
+  void PartitionsParticles(); // also keeps the cells in sync with positions for queries between steps
+  void UpdateSleepingCells(); // called by the partition when sleeping is enabled
 
   std::size_t GetCellsAcross() const { return m_CellsAcross; }
   std::vector<Cell>& GetCells() { return m_Cells; }
+  const std::vector<Cell>& GetCells() const { return m_Cells; }
+  float GetCellSize() const { return m_CellSize; }
+
+  // Settled cells can be put to sleep, so the color force skips their particles. A cell sleeps when
+  // every particle in it and its neighbors moves and is pushed less than the thresholds, and its
+  // neighbors keep the same particles. Anything waking a neighbor wakes the cell on the next step.
+  void SetSleeping(bool sleeping = true);
+  bool IsSleeping() const { return m_Sleeping; }
+  void WakeAll(); // for changes to the forces, which a settled cell can't notice by itself
+  void SetSleepThresholds(float displacement, float force) { m_SleepDisplacement = displacement; m_SleepForce = force; }
+  float GetSleepDisplacement() const { return m_SleepDisplacement; }
+  float GetSleepForce() const { return m_SleepForce; }
+  const std::uint8_t* GetSleepingCells() const { return m_Sleeping ? m_CellAsleep.data() : nullptr; }
+  std::size_t GetNumSleepingCells() const { return m_NumSleepingCells; }
+
+  // Scratch memory for the current step, reset when the particles are partitioned.
+  FrameArena& GetFrameArena() { return m_FrameArena; }
 
   float GetInteractionRadius() const { return m_InteractionRadius; }
-  void SetInteractionRadius(float radius = 40.0f) { m_InteractionRadius = radius; AllocateCells(); }
+  void SetInteractionRadius(float radius = s_DefaultInteractionRadius) { m_InteractionRadius = radius; AllocateCells(); }
 private:
   // Cell system to reduce physics misses, the size of a cell is as close to the
   // interaction radius as possible, so we only check neighboring cells for physics.
   std::vector<Cell> m_Cells;
   float m_CellSize;
   std::size_t m_CellsAcross;
+  FrameArena m_FrameArena;
+
+  // Sleeping cells
+  bool m_Sleeping = false;
+  float m_SleepDisplacement = 0.01f; // per step
+  float m_SleepForce = 0.05f;
+  std::vector<std::uint8_t> m_CellAsleep;
+  std::vector<ParticleIndex> m_LastCellCounts;
+  std::size_t m_NumSleepingCells = 0;
 
   // Constants the define the parameters of the simulation
-  float m_InteractionRadius = 40.0f;
+  float m_InteractionRadius = s_DefaultInteractionRadius;
   float m_FrictionStrength = 2.0f;
+  BoundaryMode m_BoundaryMode = BoundaryMode::Periodic;
 
 private:
   std::vector<Particle> m_Particles;
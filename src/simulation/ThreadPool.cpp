@@ -0,0 +1,78 @@
+#include "ThreadPool.h"
+
+namespace Speck
+{
+
+ThreadPool::ThreadPool(std::size_t numThreads)
+{
+  // The dispatching thread does work too, so we need one less worker.
+  std::size_t numWorkers = (numThreads > 1) ? numThreads - 1 : 1;
+
+  m_Threads.reserve(numWorkers);
+  for (std::size_t i = 0; i < numWorkers; i++)
+    m_Threads.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Shutdown = true;
+  }
+  m_WorkReady.notify_all();
+
+  for (std::thread& thread : m_Threads)
+    thread.join();
+}
+
+void ThreadPool::Run(std::size_t numJobs, JobFunction function, void* context)
+{
+  if (numJobs == 0) return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Function = function;
+    m_Context = context;
+    m_NumJobs = numJobs;
+    m_NextJob.store(0);
+    m_BusyWorkers = m_Threads.size();
+    m_Generation++;
+  }
+  m_WorkReady.notify_all();
+
+  ExecuteJobs();
+
+  // Wait for every worker to check in, so none of them still reference the job afterwards.
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_WorkDone.wait(lock, [this] { return m_BusyWorkers == 0; });
+}
+
+void ThreadPool::ExecuteJobs()
+{
+  std::size_t job;
+  while ((job = m_NextJob.fetch_add(1)) < m_NumJobs)
+    m_Function(m_Context, job);
+}
+
+void ThreadPool::WorkerLoop()
+{
+  std::uint64_t generation = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_WorkReady.wait(lock, [&] { return m_Shutdown || m_Generation != generation; });
+      if (m_Shutdown) return;
+      generation = m_Generation;
+    }
+
+    ExecuteJobs();
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      if (--m_BusyWorkers == 0) m_WorkDone.notify_one();
+    }
+  }
+}
+
+}
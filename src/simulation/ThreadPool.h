@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+namespace Speck
+{
+
+/// A fixed set of worker threads that live as long as the pool, so dispatching work
+/// doesn't create threads or allocate. Dispatch() hands out job indices to the workers
+/// and the calling thread, and returns once every job has finished.
+class ThreadPool
+{
+public:
+  ThreadPool(std::size_t numThreads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Calls func(job) for every job in [0, numJobs). The function is only referenced, never copied.
+  template <typename Func>
+  void Dispatch(std::size_t numJobs, Func& func)
+  {
+    Run(numJobs, [](void* context, std::size_t job) { (*static_cast<Func*>(context))(job); }, &func);
+  }
+
+  std::size_t GetNumThreads() const { return m_Threads.size(); }
+
+private:
+  using JobFunction = void (*)(void* context, std::size_t job);
+
+  void Run(std::size_t numJobs, JobFunction function, void* context);
+  void ExecuteJobs();
+  void WorkerLoop();
+
+private:
+  std::vector<std::thread> m_Threads;
+
+  std::mutex m_Mutex;
+  std::condition_variable m_WorkReady;
+  std::condition_variable m_WorkDone;
+  std::uint64_t m_Generation = 0; // bumped for every dispatch, wakes the workers
+  std::size_t m_BusyWorkers = 0;
+  bool m_Shutdown = false;
+
+  // The current dispatch
+  JobFunction m_Function = nullptr;
+  void* m_Context = nullptr;
+  std::size_t m_NumJobs = 0;
+  std::atomic<std::size_t> m_NextJob = 0;
+};
+
+}
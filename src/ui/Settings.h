@@ -4,13 +4,15 @@
 
 #include "ui/Shapes.h"
 
-#include "simulation/ColorMatrix.h"
+#include "simulation/SharedColorMatrix.h"
 
 namespace Speck::UI
 {
 
-void DisplayColorMatrix(ColorMatrix& matrix)
+// Shows the staged matrix, edits only reach the simulation once they are published.
+void DisplayColorMatrix(SharedColorMatrix& sharedMatrix)
 {
+  const ColorMatrix& matrix = sharedMatrix.GetStaging();
   std::size_t colors = matrix.GetNumColors();
   if (ImGui::BeginTable("color_matrix", colors + 1, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_NoHostExtendX | ImGuiTableFlags_SizingFixedSame))
   {
@@ -57,12 +59,12 @@ void DisplayColorMatrix(ColorMatrix& matrix)
         if (ImGui::IsItemClicked(ImGuiMouseButton_Left)) 
         {
           scale += 0.1f;
-          matrix.SetAttractionScale(row, column, glm::clamp(scale, -1.0f, 1.0f));
+          sharedMatrix.Edit().SetAttractionScale(row, column, glm::clamp(scale, -1.0f, 1.0f));
         }
         else if (ImGui::IsItemClicked(ImGuiMouseButton_Right))
         {
           scale -= 0.1f;
-          matrix.SetAttractionScale(row, column, glm::clamp(scale, -1.0f, 1.0f));
+          sharedMatrix.Edit().SetAttractionScale(row, column, glm::clamp(scale, -1.0f, 1.0f));
         };
       }
     }